@@ -0,0 +1,70 @@
+#include "ColorPalette.h"
+#include "FireParticleSystem.h"
+#include "Simd.h"
+#include <algorithm>
+
+namespace {
+    float Clamp01(float x) {
+        return std::min(std::max(x, 0.0f), 1.0f);
+    }
+
+    Color BlackbodyRamp(float temperature) {
+        float heat = (temperature - 600.0f) / 1200.0f;
+        auto channel = [heat](float offset) {
+            return static_cast<unsigned char>(255.0f * Clamp01(heat * 3.0f - offset));
+        };
+        float alpha = Clamp01((temperature - FireParticleSystem::AMBIENT_TEMPERATURE) / 600.0f);
+        return { channel(0.0f), channel(1.0f), channel(2.0f), static_cast<unsigned char>(alpha * 255.0f) };
+    }
+
+    // fast particles shift from white towards red
+    Color RedShiftRamp(float speed) {
+        float redShift = std::min(speed / 200.0f, 1.0f);
+        Color color;
+        color.r = 255;
+        color.g = (unsigned char)(255 * (1.0f - redShift * 0.7f));
+        color.b = (unsigned char)(255 * (1.0f - redShift * 0.9f));
+        color.a = 255;
+        return color;
+    }
+}
+
+ColorPalette::ColorPalette(float minValue, float maxValue, Color (*ramp)(float)) :
+    minValue(minValue),
+    scale((SIZE - 1) / (maxValue - minValue)) {
+    for (int i = 0; i < SIZE; i++) {
+        entries[i] = ramp(minValue + i / scale);
+    }
+}
+
+const ColorPalette& ColorPalette::Blackbody() {
+    static const ColorPalette palette(FireParticleSystem::AMBIENT_TEMPERATURE, 2100.0f, BlackbodyRamp);
+    return palette;
+}
+
+const ColorPalette& ColorPalette::RedShift() {
+    static const ColorPalette palette(0.0f, 200.0f, RedShiftRamp);
+    return palette;
+}
+
+void ColorPalette::LookupBatch(const float* values, int count, Color* out) const {
+    const Float4 offset4 = Float4::Set1(minValue);
+    const Float4 scale4 = Float4::Set1(scale);
+    const Float4 half4 = Float4::Set1(0.5f);
+    const Float4 zero4 = Float4::Set1(0.0f);
+    const Float4 last4 = Float4::Set1(static_cast<float>(SIZE - 1));
+
+    int i = 0;
+    int index[4];
+    for (; i + 4 <= count; i += 4) {
+        Float4 position = (Float4::Load(values + i) - offset4) * scale4 + half4;
+        Min(Max(position, zero4), last4).StoreInt(index);
+        out[i] = entries[index[0]];
+        out[i + 1] = entries[index[1]];
+        out[i + 2] = entries[index[2]];
+        out[i + 3] = entries[index[3]];
+    }
+    for (; i < count; i++) {
+        out[i] = Lookup(values[i]);
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+#ifndef COLOR_PALETTE_H
+#define COLOR_PALETTE_H
+
+#include "raylib.h"
+
+// Color ramp sampled into a table once, so per-particle coloring is an index
+// computation and a load. Values outside [MinValue, MaxValue] clamp to the
+// ends. The shared palettes are built on first use and are read-only after
+// that, so they can be used from any thread.
+class ColorPalette {
+public:
+    static const int SIZE = 1024;
+
+    // Incandescence of the fire by temperature in kelvin: dark red through
+    // orange and yellow to white, fading out towards ambient
+    static const ColorPalette& Blackbody();
+    // Tint of the black hole particles by speed in px/s (alpha is 255, the
+    // caller fades by lifetime)
+    static const ColorPalette& RedShift();
+
+    Color Lookup(float value) const {
+        float index = (value - minValue) * scale + 0.5f;
+        index = index < 0.0f ? 0.0f : (index > SIZE - 1 ? SIZE - 1 : index);
+        return entries[static_cast<int>(index)];
+    }
+
+    // out[i] = Lookup(values[i]). Indices are computed 4 at a time; the
+    // table loads stay scalar as SSE2 has no gather.
+    void LookupBatch(const float* values, int count, Color* out) const;
+
+    float MinValue() const { return minValue; }
+    float MaxValue() const { return minValue + (SIZE - 1) / scale; }
+
+private:
+    ColorPalette(float minValue, float maxValue, Color (*ramp)(float));
+
+    Color entries[SIZE];
+    float minValue;
+    float scale;  // table entries per unit
+};
+
+#endif
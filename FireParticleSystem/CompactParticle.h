@@ -0,0 +1,86 @@
+#pragma once
+#ifndef COMPACT_PARTICLE_H
+#define COMPACT_PARTICLE_H
+
+#include "raylib.h"
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+// Bandwidth-friendly accretion particle (10 bytes instead of 28).
+// Position is 16-bit fixed point relative to the black hole, velocity is
+// stored as half floats and lifetime as 8 bits. Color is not stored at all,
+// it is derived from velocity and lifetime when the particle is drawn.
+struct CompactParticle {
+    int16_t x, y;
+    uint16_t vx, vy;
+    uint8_t lifetime;
+    uint8_t active;
+
+    static constexpr float POSITION_SCALE = 32.0f;  // 1/32 pixel steps, +-1024 px range
+    static constexpr float POSITION_RANGE = 32767.0f / POSITION_SCALE;
+
+    // Returns false when the position falls outside the representable range
+    bool Pack(Vector2 pos, Vector2 vel, float life, Vector2 origin) {
+        float rx = pos.x - origin.x;
+        float ry = pos.y - origin.y;
+        if (fabsf(rx) > POSITION_RANGE || fabsf(ry) > POSITION_RANGE) {
+            active = 0;
+            return false;
+        }
+        x = static_cast<int16_t>(lrintf(rx * POSITION_SCALE));
+        y = static_cast<int16_t>(lrintf(ry * POSITION_SCALE));
+        vx = FloatToHalf(vel.x);
+        vy = FloatToHalf(vel.y);
+        float l = life < 0.0f ? 0.0f : (life > 1.0f ? 1.0f : life);
+        lifetime = static_cast<uint8_t>(l * 255.0f + 0.5f);
+        active = 1;
+        return true;
+    }
+
+    Vector2 Position(Vector2 origin) const {
+        return { origin.x + x / POSITION_SCALE, origin.y + y / POSITION_SCALE };
+    }
+
+    Vector2 Velocity() const {
+        return { HalfToFloat(vx), HalfToFloat(vy) };
+    }
+
+    float Lifetime() const {
+        return lifetime / 255.0f;
+    }
+
+    // IEEE 754 binary16 conversion, round to nearest, subnormals flushed to zero,
+    // out of range values saturate instead of becoming infinity
+    static uint16_t FloatToHalf(float f) {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+        int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xffu) - 127 + 15;
+        uint32_t mantissa = bits & 0x7fffffu;
+
+        if (exponent <= 0) return sign;
+        if (exponent >= 31) return static_cast<uint16_t>(sign | 0x7bffu);  // saturate
+
+        uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+        if (mantissa & 0x1000u) half++;  // carry into the exponent is still correct
+        if (half >= 0x7c00u) half = 0x7bffu;
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    static float HalfToFloat(uint16_t h) {
+        uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+        uint32_t exponent = (h >> 10) & 0x1fu;
+        uint32_t mantissa = h & 0x3ffu;
+
+        uint32_t bits = sign;
+        if (exponent != 0) {
+            bits |= ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        }
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+};
+
+#endif
@@ -0,0 +1,180 @@
+#include "Emitter.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Radial velocities take their direction from a table instead of
+    // evaluating cos and sin per particle
+    const int DIRECTIONS = 1024;
+
+    struct UnitCircle {
+        float x[DIRECTIONS + 1];  // one spare entry in case rounding reaches 1
+        float y[DIRECTIONS + 1];
+
+        UnitCircle() {
+            for (int i = 0; i <= DIRECTIONS; i++) {
+                float angle = 6.28318530718f * i / DIRECTIONS;
+                x[i] = cosf(angle);
+                y[i] = sinf(angle);
+            }
+        }
+    };
+
+    const UnitCircle& Directions() {
+        static const UnitCircle circle;
+        return circle;
+    }
+
+    // column = offset + u * scale, over whole SIMD widths (columns are padded)
+    void Affine(const float* u, float offset, float scale, int count, float* out) {
+        const Float4 offset4 = Float4::Set1(offset);
+        const Float4 scale4 = Float4::Set1(scale);
+        for (int i = 0; i < count; i += 4) {
+            (offset4 + Float4::Load(u + i) * scale4).Store(out + i);
+        }
+    }
+
+    int Padded(int count) {
+        return (count + 3) & ~3;
+    }
+}
+
+EmitterDesc::EmitterDesc() :
+    rate(0),
+    burst(0),
+    shape(SHAPE_BOX),
+    extent({ 0, 0 }),
+    axis({ 1, 0 }),
+    velocity(VELOCITY_BOX),
+    velocityMin({ 0, 0 }),
+    velocityMax({ 0, 0 }),
+    speedMin(0),
+    speedMax(0),
+    baseVelocity({ 0, 0 }),
+    lifetimeMin(1),
+    lifetimeMax(1) {
+}
+
+void SpawnBatch::Clear() {
+    x.clear();
+    y.clear();
+    velocityX.clear();
+    velocityY.clear();
+    lifetime.clear();
+}
+
+void FillUniform(Random& rng, float min, float max, int count, float* out) {
+    // the same arithmetic as Random::GetFloat, so it draws identical values
+    int i = 0;
+    const Float4 min4 = Float4::Set1(min);
+    const Float4 range4 = Float4::Set1(max - min);
+    const Float4 unit4 = Float4::Set1(1.0f / 16777216.0f);
+    for (; i + 4 <= count; i += 4) {
+        float bits[4];
+        for (int lane = 0; lane < 4; lane++) {
+            bits[lane] = static_cast<float>(rng.Next() >> 8);
+        }
+        (min4 + Float4::Load(bits) * unit4 * range4).Store(out + i);
+    }
+    for (; i < count; i++) {
+        out[i] = rng.GetFloat(min, max);
+    }
+}
+
+void GenerateSpawns(const EmitterDesc& desc, Vector2 origin, int count, Random& rng, SpawnBatch& out) {
+    if (count <= 0) return;
+    const int padded = Padded(count);
+    const size_t at = out.Size();
+    const size_t total = at + padded;
+    out.x.resize(total);
+    out.y.resize(total);
+    out.velocityX.resize(total);
+    out.velocityY.resize(total);
+    out.lifetime.resize(total);
+    float* x = out.x.data() + at;
+    float* y = out.y.data() + at;
+    float* vx = out.velocityX.data() + at;
+    float* vy = out.velocityY.data() + at;
+
+    // columns of uniform [0, 1) numbers, each padded to the SIMD width
+    std::vector<float> u(static_cast<size_t>(padded) * 2, 0.0f);
+    float* u0 = u.data();
+    float* u1 = u.data() + padded;
+
+    if (desc.shape == EmitterDesc::SHAPE_LINE) {
+        FillUniform(rng, -desc.extent.x, desc.extent.x, count, u0);
+        const Float4 ox = Float4::Set1(origin.x), oy = Float4::Set1(origin.y);
+        const Float4 ax = Float4::Set1(desc.axis.x), ay = Float4::Set1(desc.axis.y);
+        for (int i = 0; i < padded; i += 4) {
+            Float4 along = Float4::Load(u0 + i);
+            (ox + ax * along).Store(x + i);
+            (oy + ay * along).Store(y + i);
+        }
+    }
+    else {
+        FillUniform(rng, 0.0f, 1.0f, count, u0);
+        FillUniform(rng, 0.0f, 1.0f, count, u1);
+        Affine(u0, origin.x - desc.extent.x, 2.0f * desc.extent.x, padded, x);
+        Affine(u1, origin.y - desc.extent.y, 2.0f * desc.extent.y, padded, y);
+    }
+
+    if (desc.velocity == EmitterDesc::VELOCITY_RADIAL) {
+        FillUniform(rng, 0.0f, static_cast<float>(DIRECTIONS), count, u0);
+        FillUniform(rng, desc.speedMin, desc.speedMax, count, u1);
+        const UnitCircle& circle = Directions();
+        const Float4 bx = Float4::Set1(desc.baseVelocity.x), by = Float4::Set1(desc.baseVelocity.y);
+        int index[4];
+        for (int i = 0; i < padded; i += 4) {
+            Float4::Load(u0 + i).StoreInt(index);
+            Float4 speed = Float4::Load(u1 + i);
+            Float4 dx = Float4::Set(circle.x[index[0]], circle.x[index[1]], circle.x[index[2]], circle.x[index[3]]);
+            Float4 dy = Float4::Set(circle.y[index[0]], circle.y[index[1]], circle.y[index[2]], circle.y[index[3]]);
+            (bx + dx * speed).Store(vx + i);
+            (by + dy * speed).Store(vy + i);
+        }
+    }
+    else {
+        FillUniform(rng, 0.0f, 1.0f, count, u0);
+        FillUniform(rng, 0.0f, 1.0f, count, u1);
+        Affine(u0, desc.baseVelocity.x + desc.velocityMin.x, desc.velocityMax.x - desc.velocityMin.x, padded, vx);
+        Affine(u1, desc.baseVelocity.y + desc.velocityMin.y, desc.velocityMax.y - desc.velocityMin.y, padded, vy);
+    }
+
+    FillUniform(rng, desc.lifetimeMin, desc.lifetimeMax, count, out.lifetime.data() + at);
+
+    // drop the padding
+    const size_t size = at + count;
+    out.x.resize(size);
+    out.y.resize(size);
+    out.velocityX.resize(size);
+    out.velocityY.resize(size);
+    out.lifetime.resize(size);
+}
+
+void SpawnQueue::Push(const EmitterDesc& desc, Vector2 origin, int count) {
+    if (count > 0) bursts.push_back({ desc, origin, count });
+}
+
+int SpawnQueue::Drain(int budget, Random& rng, SpawnBatch& out) {
+    int generated = 0;
+    size_t done = 0;
+    for (; done < bursts.size() && generated < budget; done++) {
+        Burst& burst = bursts[done];
+        int count = std::min(burst.remaining, budget - generated);
+        GenerateSpawns(burst.desc, burst.origin, count, rng, out);
+        generated += count;
+        burst.remaining -= count;
+        if (burst.remaining > 0) break;
+    }
+    bursts.erase(bursts.begin(), bursts.begin() + done);
+    return generated;
+}
+
+size_t SpawnQueue::Pending() const {
+    size_t pending = 0;
+    for (const Burst& burst : bursts) {
+        pending += burst.remaining;
+    }
+    return pending;
+}
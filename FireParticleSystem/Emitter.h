@@ -0,0 +1,79 @@
+#pragma once
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#include "raylib.h"
+#include "Random.h"
+#include <cstddef>
+#include <vector>
+
+// Where and how particles are born. Plain data (every field is 4 bytes), so
+// it can be copied into queues and saved with the simulation state.
+struct EmitterDesc {
+    enum Shape {
+        SHAPE_BOX,   // uniform in origin +- extent
+        SHAPE_LINE   // uniform along axis, extent.x to either side of the origin
+    };
+    enum VelocityDistribution {
+        VELOCITY_BOX,    // each component uniform in [velocityMin, velocityMax)
+        VELOCITY_RADIAL  // uniform direction, speed uniform in [speedMin, speedMax)
+    };
+
+    float rate;       // particles per second
+    int burst;        // particles per triggered burst
+    Shape shape;
+    Vector2 extent;
+    Vector2 axis;     // unit length, SHAPE_LINE only
+    VelocityDistribution velocity;
+    Vector2 velocityMin, velocityMax;
+    float speedMin, speedMax;
+    Vector2 baseVelocity;  // added to every particle, e.g. the emitter's own motion
+    float lifetimeMin, lifetimeMax;
+
+    EmitterDesc();
+};
+
+// Spawned particles, one column per attribute
+struct SpawnBatch {
+    std::vector<float> x, y;
+    std::vector<float> velocityX, velocityY;
+    std::vector<float> lifetime;
+
+    size_t Size() const { return lifetime.size(); }
+    void Clear();
+};
+
+// Appends count particles drawn from desc around origin. The random numbers
+// are drawn one column at a time and turned into particles 4 at a time.
+void GenerateSpawns(const EmitterDesc& desc, Vector2 origin, int count, Random& rng, SpawnBatch& out);
+
+// out[i] uniform in [min, max) for i < count, 4 at a time
+void FillUniform(Random& rng, float min, float max, int count, float* out);
+
+// Bursts waiting to be spawned. A burst larger than the frame's budget is
+// spread over the following frames instead of spawning all at once.
+class SpawnQueue {
+public:
+    struct Burst {
+        EmitterDesc desc;
+        Vector2 origin;
+        int remaining;
+    };
+
+    void Push(const EmitterDesc& desc, Vector2 origin, int count);
+    // Generates up to budget particles, oldest burst first, and returns how
+    // many it generated
+    int Drain(int budget, Random& rng, SpawnBatch& out);
+
+    size_t Pending() const;
+    bool Empty() const { return bursts.empty(); }
+    void Clear() { bursts.clear(); }
+    // For saving and loading with the simulation state
+    std::vector<Burst>& Bursts() { return bursts; }
+    const std::vector<Burst>& Bursts() const { return bursts; }
+
+private:
+    std::vector<Burst> bursts;
+};
+
+#endif
@@ -1,31 +1,62 @@
 #include "raylib.h"
+#include "ColorPalette.h"
+#include "CompactParticle.h"
+#include "Emitter.h"
+#include "FireParticleSystem.h"
+#include "FluidGrid.h"
+#include "GravitationalLens.h"
+#include "KeplerOrbit.h"
+#include "MpscQueue.h"
+#include "ParticlePool.h"
+#include "RailParticles.h"
+#include "Random.h"
+#include "RaylibRenderer.h"
+#include "SlotMap.h"
+#include "SoftBody.h"
+#include "SoftwareRenderer.h"
+#include "ThreadPool.h"
+#include "TimeWarp.h"
+#include "Timeline.h"
+#include "TripleBuffer.h"
+#include "UniformGrid.h"
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
 
 #define SCREEN_WIDTH 1200
 #define SCREEN_HEIGHT 800
 #define BLACK_HOLE_PI 3.14159265359f
 
-float GetRandomFloat(float min, float max) {
-    return min + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / (max - min)));
+// Red shift tint from particle speed, faded out with lifetime
+Color RedShiftColor(Vector2 velocity, float lifetime) {
+    float speed = sqrt(velocity.x * velocity.x + velocity.y * velocity.y);
+    float alpha = std::max(std::min(lifetime, 1.0f), 0.0f);
+    Color color = ColorPalette::RedShift().Lookup(speed);
+    color.a = (unsigned char)(255 * alpha);
+    return color;
 }
 
+// Color is not stored, it is derived from velocity and lifetime when drawn.
+// Free particles live in an AccretionParticlePool, this is one of them.
 struct Particle {
     Vector2 position;
     Vector2 velocity;
-    Color color;
     float mass;
     float lifetime;
-    bool active;
 
-    Particle() {
-        Reset();
-    }
+    Particle() : position({ 0, 0 }), velocity({ 0, 0 }), mass(1.0f), lifetime(0) {}
 
-    void Reset() {
-        float angle = GetRandomFloat(0, BLACK_HOLE_PI * 2);
-        float radius = GetRandomFloat(200, 300);
+    void Reset(Random& rng) {
+        float angle = rng.GetFloat(0, BLACK_HOLE_PI * 2);
+        float radius = rng.GetFloat(200, 300);
         position.x = static_cast<float>(SCREEN_WIDTH) / 2 + cosf(angle) * radius;
         position.y = static_cast<float>(SCREEN_HEIGHT) / 2 + sinf(angle) * radius;
 
@@ -33,18 +64,25 @@ struct Particle {
         velocity.x = -sinf(angle) * speed;
         velocity.y = cosf(angle) * speed;
 
-        mass = GetRandomFloat(0.1f, 1.0f);
+        mass = rng.GetFloat(0.1f, 1.0f);
         lifetime = 1.0f;
-        active = true;
-
-        float temp = GetRandomFloat(0.5f, 1.0f);
-        color.r = (unsigned char)(255 * temp);
-        color.g = (unsigned char)(255 * temp);
-        color.b = 255;
-        color.a = 255;
     }
 };
 
+// Columns of the black hole's free particles, which fall in under a capped
+// inverse-square pull
+struct AccretionLayout {
+    enum Column {
+        X, Y,
+        VELOCITY_X, VELOCITY_Y,
+        MASS,
+        LIFETIME,
+        COLUMNS
+    };
+};
+
+typedef ParticlePool<AccretionLayout, EulerIntegrator, PointGravityForce> AccretionParticlePool;
+
 struct Planet {
     Vector2 position;
     Vector2 velocity;
@@ -55,26 +93,103 @@ struct Planet {
     float rotation;
     float stretchFactor;
     float originalSize;
+    float shed;          // fraction of the planet torn off into debris so far
+    bool onConic;        // propagated analytically by orbit instead of integrated
+    KeplerOrbit orbit;
+    SoftBodyState body;  // lattice offsets around position, deformed by tides
+
+    Planet() = default;  // filled in by BlackHole::LoadState
 
-    Planet(Vector2 pos) {
+    Planet(Vector2 pos, Random& rng) {
         position = pos;
         velocity = {0, 0};
-        originalSize = GetRandomFloat(20, 40);
+        originalSize = rng.GetFloat(20, 40);
         size = originalSize;
         mass = size * 2.0f;
         active = true;
         rotation = 0;
         stretchFactor = 1.0f;
+        shed = 0.0f;
+        onConic = false;
+        body.Reset(originalSize);
         
-        color.r = (unsigned char)GetRandomFloat(100, 255);
-        color.g = (unsigned char)GetRandomFloat(100, 255);
-        color.b = (unsigned char)GetRandomFloat(100, 255);
+        color.r = (unsigned char)rng.GetFloat(100, 255);
+        color.g = (unsigned char)rng.GetFloat(100, 255);
+        color.b = (unsigned char)rng.GetFloat(100, 255);
         color.a = 255;
     }
+};
 
-private:
-    float GetRandomFloat(float min, float max) {
-        return min + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / (max - min)));
+typedef SlotHandle PlanetHandle;
+
+// Planet-planet broadphase numbers of the last step
+struct PlanetCollisionStats {
+    int planets;
+    int candidatePairs;  // pairs the grid had to test, vs planets^2 / 2 brute force
+    int overlaps;
+    int merges;
+    int particlesAbsorbed;
+    int particlesScattered;
+};
+
+// Input that changes the simulation. Commands are applied between steps so
+// the timeline can log and replay them.
+struct SimCommand {
+    enum Type {
+        ADD_PLANET,
+        SET_COMPACT_LAYOUT,
+        SET_ON_RAILS,
+        SET_KEPLER_PROPAGATION,
+        REMOVE_PLANET,
+        SET_PLANET_MASS,
+        MOVE_HOLE
+    };
+
+    Type type;
+    Vector2 position;  // ADD_PLANET, MOVE_HOLE
+    bool enabled;      // SET_* toggles
+    PlanetHandle planet;  // REMOVE_PLANET, SET_PLANET_MASS
+    float mass;
+
+    static SimCommand Make(Type type) {
+        SimCommand command;
+        command.type = type;
+        command.position = { 0, 0 };
+        command.enabled = false;
+        command.planet = PlanetHandle::Null();
+        command.mass = 0;
+        return command;
+    }
+
+    static SimCommand AddPlanet(Vector2 position) {
+        SimCommand command = Make(ADD_PLANET);
+        command.position = position;
+        return command;
+    }
+
+    static SimCommand MoveHole(Vector2 position) {
+        SimCommand command = Make(MOVE_HOLE);
+        command.position = position;
+        return command;
+    }
+
+    static SimCommand Toggle(Type type, bool enabled) {
+        SimCommand command = Make(type);
+        command.enabled = enabled;
+        return command;
+    }
+
+    static SimCommand RemovePlanet(PlanetHandle planet) {
+        SimCommand command = Make(REMOVE_PLANET);
+        command.planet = planet;
+        return command;
+    }
+
+    static SimCommand SetPlanetMass(PlanetHandle planet, float mass) {
+        SimCommand command = Make(SET_PLANET_MASS);
+        command.planet = planet;
+        command.mass = mass;
+        return command;
     }
 };
 
@@ -83,22 +198,80 @@ private:
     Vector2 position;
     float radius;
     float eventHorizonRadius;
-    std::vector<Particle> particles;
+    AccretionParticlePool particles;
+    std::vector<CompactParticle> compactParticles;  // used instead of particles in compact layout
     std::vector<Vector2> accretionDisk;
-    std::vector<Planet> planets;
-    float time;
+    SlotMap<Planet> planets;  // handles stay valid while planets are removed
+    double time;
+    int64_t step;
+    Random rng;  // part of the saved state, so re-simulation is exact
+    int baseParticleCount;
+    bool useCompactLayout;
+
+    // on-rails mode: unperturbed particles orbit analytically in polar form
+    RailParticles rails;
+    bool useRails;
+    float railInnerRadius;     // below this the full integrator takes over
+    float railPerturbMargin;   // distance beyond a planet's size that knocks particles off
+    float railDrift;           // inward migration on the rails, pixels per second
+
+    // planets outside the tidal zone follow closed-form conics
+    bool useKepler;
+    static constexpr float KEPLER_ENTER_FACTOR = 1.5f;  // times the tidal zone radius
+    static constexpr float KEPLER_EXIT_FACTOR = 1.25f;
+
+    // scratch for ParallelStep, kept to avoid allocations every step
+    std::vector<std::vector<uint32_t>> chunkRespawns;
+    std::vector<uint32_t> respawnIndices;
+
+    // planet collisions, rebuilt every step
+    UniformGrid planetGrid;
+    std::vector<Vector2> planetPositions;
+    std::vector<float> planetRadii;
+    PlanetCollisionStats collisionStats;
+
+    // debris torn off planets, spawned at most DEBRIS_SPAWN_BUDGET per step
+    SpawnQueue debris;
+    SpawnBatch debrisBatch;
+    SoftBodySolver bodySolver;  // scratch, refilled from the planets every step
+    std::vector<int> bodyPlanets;  // dense index of the planet in each solver slot
 
-    static const int NUM_PARTICLES = 1000;
     static const int DISK_SEGMENTS = 720;
+    static const int DEBRIS_SPAWN_BUDGET = 64;
+    static const int DEBRIS_PER_PLANET = 160;    // particles a planet turns into in total
+    static constexpr float DEBRIS_SPREAD = 20.0f;  // speed around the planet's own velocity
+    static constexpr float DISRUPTION_STRETCH = 1.5f;  // stretched this far a planet is torn apart completely
+    static constexpr float DISRUPTION_HORIZON = 1.25f;  // and at this many horizon radii
+    static const int STEP_GRAIN = 16384;  // particles per parallel chunk
+    static constexpr float PLANET_GRAZE_COSINE = 0.5f;  // hits within 60 degrees of the surface normal are absorbed
+    static constexpr float PLANET_RESTITUTION = 0.5f;
+    static constexpr float RAIL_SPEED_TOLERANCE = 0.05f;  // off the circular speed, still admitted to the rails
 
 public:
-    BlackHole() :
+    static const int NUM_PARTICLES = 1000;
+
+    BlackHole(int particleCount = NUM_PARTICLES, uint64_t seed = 1234) :
         position({ SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 }),
         radius(30.0f),
         eventHorizonRadius(20.0f),
-        time(0) {
+        time(0),
+        step(0),
+        rng(seed),
+        baseParticleCount(particleCount),
+        useCompactLayout(false),
+        useRails(false),
+        railInnerRadius(100.0f),
+        railPerturbMargin(30.0f),
+        railDrift(0.0f),  // the pull has no drag, a circular orbit doesn't decay
+        useKepler(true),
+        collisionStats() {
 
-        particles.resize(NUM_PARTICLES);
+        particles.Resize(particleCount);
+        for (int i = 0; i < particleCount; i++) {
+            Particle particle;
+            particle.Reset(rng);
+            StoreParticle(i, particle);
+        }
 
         for (int i = 0; i < DISK_SEGMENTS; i++) {
             float angle = (float)i * 2 * BLACK_HOLE_PI / DISK_SEGMENTS;
@@ -111,8 +284,9 @@ public:
         }
     }
 
-    void AddPlanet(Vector2 pos) {
-        planets.emplace_back(pos);
+    PlanetHandle AddPlanet(Vector2 pos) {
+        PlanetHandle handle = planets.Insert(Planet(pos, rng));
+        Planet& planet = *planets.Get(handle);
         Vector2 toCenter = {
             position.x - pos.x,
             position.y - pos.y
@@ -120,68 +294,342 @@ public:
         float dist = sqrt(toCenter.x * toCenter.x + toCenter.y * toCenter.y);
         float angle = atan2f(toCenter.y, toCenter.x);
         float orbitalSpeed = sqrt(2000.0f / dist) * 0.8f;
-        planets.back().velocity = {
+        planet.velocity = {
             -sinf(angle) * orbitalSpeed,
             cosf(angle) * orbitalSpeed
         };
+        return handle;
     }
 
-    void Update() {
-        time += GetFrameTime();
+    // Stale handles (planet removed or swallowed) are ignored
+    void RemovePlanet(PlanetHandle handle) {
+        planets.Remove(handle);
+    }
 
-        for (auto& particle : particles) {
-            if (!particle.active) {
-                particle.Reset();
-                continue;
+    void SetPlanetMass(PlanetHandle handle, float mass) {
+        Planet* planet = planets.Get(handle);
+        if (planet && mass > 0.0f) planet->mass = mass;
+    }
+
+    const PlanetCollisionStats& CollisionStats() const { return collisionStats; }
+
+    // nullptr once the planet is gone
+    const Planet* GetPlanet(PlanetHandle handle) const { return planets.Get(handle); }
+
+    size_t PlanetCount() const { return planets.Size(); }
+    PlanetHandle PlanetHandleAt(size_t i) const { return planets.HandleAt(i); }
+
+    // Planet under point, or a null handle
+    PlanetHandle PlanetAt(Vector2 point) const {
+        for (size_t i = planets.Size(); i-- > 0;) {
+            const Planet& planet = planets[i];
+            float dx = point.x - planet.position.x;
+            float dy = point.y - planet.position.y;
+            if (planet.active && dx * dx + dy * dy <= planet.size * planet.size) return planets.HandleAt(i);
+        }
+        return PlanetHandle::Null();
+    }
+
+    // Free particles and planets stay where they are. Compact particles are
+    // repacked around the new origin, rail particles move with the hole, and
+    // conics are refitted on the next step.
+    void MoveTo(Vector2 target) {
+        for (auto& cp : compactParticles) {
+            if (!cp.active) continue;
+            cp.Pack(cp.Position(position), cp.Velocity(), cp.Lifetime(), target);
+        }
+        for (auto& planet : planets) planet.onConic = false;
+        position = target;
+    }
+
+    // Switches between the full precision and the compact particle layout,
+    // converting the live particles
+    void SetCompactLayout(bool enabled) {
+        if (enabled == useCompactLayout) return;
+
+        if (enabled) {
+            compactParticles.resize(particles.Size());
+            for (size_t i = 0; i < particles.Size(); i++) {
+                const Particle p = ParticleAt(i);
+                compactParticles[i].Pack(p.position, p.velocity, p.lifetime, position);
+            }
+            particles = AccretionParticlePool();
+        }
+        else {
+            // the pool only holds live particles
+            particles.Clear();
+            for (const CompactParticle& cp : compactParticles) {
+                if (!cp.active) continue;
+                Particle p;
+                p.position = cp.Position(position);
+                p.velocity = cp.Velocity();
+                p.lifetime = cp.Lifetime();
+                StoreParticle(particles.Add(), p);
             }
+            compactParticles.clear();
+            compactParticles.shrink_to_fit();
+        }
+        useCompactLayout = enabled;
+    }
 
-            Vector2 toCenter = {
-                position.x - particle.position.x,
-                position.y - particle.position.y
-            };
-            float dist = sqrt(toCenter.x * toCenter.x + toCenter.y * toCenter.y);
+    bool IsCompactLayout() const { return useCompactLayout; }
 
-            Vector2 direction = {
-                toCenter.x / dist,
-                toCenter.y / dist
-            };
+    // Puts near-circular particles outside railInnerRadius on rails, or hands
+    // every rail particle back to the full integrator
+    void SetOnRails(bool enabled) {
+        if (enabled == useRails) return;
+        useRails = enabled;
 
-            float forceMagnitude = 2000.0f / (dist * dist);
-            forceMagnitude = std::min(forceMagnitude, 50.0f);
+        if (enabled) {
+            size_t kept = 0;
+            for (size_t i = 0; i < particles.Size(); i++) {
+                if (AddToRails(ParticleAt(i))) continue;
+                particles.Copy(kept++, i);
+            }
+            particles.Resize(kept);
+
+            kept = 0;
+            for (size_t i = 0; i < compactParticles.size(); i++) {
+                const CompactParticle& cp = compactParticles[i];
+                if (cp.active && AddToRails(cp.Position(position), cp.Velocity(), cp.Lifetime())) continue;
+                compactParticles[kept++] = cp;
+            }
+            compactParticles.resize(kept);
+        }
+        else {
+            for (size_t i = 0; i < rails.Size(); i++) {
+                SpawnParticle(rails.Position(i, position), rails.Velocity(i, railDrift), rails.lifetime[i]);
+            }
+            rails.Clear();
+        }
+    }
 
-            particle.velocity.x += direction.x * forceMagnitude;
-            particle.velocity.y += direction.y * forceMagnitude;
+    bool IsOnRails() const { return useRails; }
 
-            particle.position.x += particle.velocity.x * GetFrameTime();
-            particle.position.y += particle.velocity.y * GetFrameTime();
+    void SetKeplerPropagation(bool enabled) {
+        useKepler = enabled;
+        if (!enabled) {
+            for (auto& planet : planets) planet.onConic = false;
+        }
+    }
 
-            if (dist < eventHorizonRadius * 1.5f) {
-                particle.lifetime -= GetFrameTime() * 2.0f;
+    bool IsKeplerPropagation() const { return useKepler; }
 
-                float angle = atan2f(toCenter.y, toCenter.x);
-                angle += GetFrameTime() * 5.0f;
-                float spiral_radius = std::max(dist * 0.95f, eventHorizonRadius);
-                particle.position.x = position.x - cosf(angle) * spiral_radius;
-                particle.position.y = position.y - sinf(angle) * spiral_radius;
+    void Apply(const SimCommand& command) {
+        switch (command.type) {
+        case SimCommand::ADD_PLANET: AddPlanet(command.position); break;
+        case SimCommand::SET_COMPACT_LAYOUT: SetCompactLayout(command.enabled); break;
+        case SimCommand::SET_ON_RAILS: SetOnRails(command.enabled); break;
+        case SimCommand::SET_KEPLER_PROPAGATION: SetKeplerPropagation(command.enabled); break;
+        case SimCommand::REMOVE_PLANET: RemovePlanet(command.planet); break;
+        case SimCommand::SET_PLANET_MASS: SetPlanetMass(command.planet, command.mass); break;
+        case SimCommand::MOVE_HOLE: MoveTo(command.position); break;
+        }
+    }
+
+    int64_t StepIndex() const { return step; }
+
+    // Everything Update() depends on, for the timeline keyframes. Particles
+    // are written column by column so keyframe deltas compress well.
+    void SaveState(std::vector<uint8_t>& out) const {
+        StateWriter writer(out);
+        writer.Write(time);
+        writer.Write(step);
+        writer.Write(position);
+        writer.Write(rng.State());
+        writer.Write(useCompactLayout);
+        writer.Write(useRails);
+        writer.Write(useKepler);
+
+        writer.Write(static_cast<uint64_t>(particles.Size()));
+        for (int c = 0; c < AccretionLayout::COLUMNS; c++) {
+            writer.WriteArray(particles[static_cast<AccretionLayout::Column>(c)]);
+        }
+
+        writer.WriteArray(compactParticles);
+        writer.WriteArray(rails.radius);
+        writer.WriteArray(rails.theta);
+        writer.WriteArray(rails.omega);
+        writer.WriteArray(rails.lifetime);
+
+        // field by field, Planet has padding
+        std::vector<uint32_t> planetIndex;
+        planets.SaveIndex(planetIndex);
+        writer.WriteArray(planetIndex);
+        writer.Write(static_cast<uint64_t>(planets.Size()));
+        writer.WriteColumn(planets.Values(), [](const Planet& p) { return p.position; });
+        writer.WriteColumn(planets.Values(), [](const Planet& p) { return p.velocity; });
+        writer.WriteColumn(planets.Values(), [](const Planet& p) { return p.size; });
+        writer.WriteColumn(planets.Values(), [](const Planet& p) { return p.mass; });
+        writer.WriteColumn(planets.Values(), [](const Planet& p) { return p.color; });
+        writer.WriteColumn(planets.Values(), [](const Planet& p) { return p.active; });
+        writer.WriteColumn(planets.Values(), [](const Planet& p) { return p.rotation; });
+        writer.WriteColumn(planets.Values(), [](const Planet& p) { return p.stretchFactor; });
+        writer.WriteColumn(planets.Values(), [](const Planet& p) { return p.originalSize; });
+        writer.WriteColumn(planets.Values(), [](const Planet& p) { return p.shed; });
+        writer.WriteColumn(planets.Values(), [](const Planet& p) { return p.onConic; });
+        writer.WriteColumn(planets.Values(), [](const Planet& p) { return p.orbit; });
+        writer.WriteColumn(planets.Values(), [](const Planet& p) { return p.body; });
+
+        writer.WriteArray(debris.Bursts());
+    }
+
+    bool LoadState(const uint8_t* data, size_t size) {
+        StateReader reader(data, size);
+        uint64_t rngState, particleCount;
+        if (!reader.Read(time) || !reader.Read(step) || !reader.Read(position) || !reader.Read(rngState) ||
+            !reader.Read(useCompactLayout) || !reader.Read(useRails) || !reader.Read(useKepler) ||
+            !reader.Read(particleCount)) {
+            return false;
+        }
+        rng.SetState(rngState);
+
+        for (int c = 0; c < AccretionLayout::COLUMNS; c++) {
+            std::vector<float>& column = particles[static_cast<AccretionLayout::Column>(c)];
+            if (!reader.ReadArray(column) || column.size() != particleCount) return false;
+        }
+        return reader.ReadArray(compactParticles) &&
+            reader.ReadArray(rails.radius) &&
+            reader.ReadArray(rails.theta) &&
+            reader.ReadArray(rails.omega) &&
+            reader.ReadArray(rails.lifetime) &&
+            ReadPlanets(reader);
+    }
+    void SetRailInnerRadius(float r) { railInnerRadius = r; }
+
+    Vector2 GetPosition() const { return position; }
+    float GetRadius() const { return radius; }
+    float GetEventHorizonRadius() const { return eventHorizonRadius; }
+
+    // Sizes the lens for a target with the given pixels per screen unit
+    void UpdateLens(GravitationalLens& lens, int width, int height, float scale) const {
+        Vector2 center = { position.x * scale, position.y * scale };
+        lens.Update(center, radius * 2.5f * scale, eventHorizonRadius * scale, width, height);
+    }
+
+    size_t ParticleCount() const {
+        return (useCompactLayout ? compactParticles.size() : particles.Size()) + rails.Size();
+    }
+
+    size_t RailCount() const { return rails.Size(); }
+
+    // Puts every free particle on the circular orbit through its position,
+    // a disk that the rails can take over entirely
+    void CircularizeParticles() {
+        for (size_t i = 0; i < particles.Size(); i++) {
+            Particle p = ParticleAt(i);
+            float dx = p.position.x - position.x;
+            float dy = p.position.y - position.y;
+            float r = sqrtf(dx * dx + dy * dy);
+            float speed = CircularSpeed(p.position, r);
+            p.velocity = { -dy / r * speed, dx / r * speed };
+            StoreParticle(i, p);
+        }
+    }
+
+    void Update(float dt) {
+        time += dt;
+        step++;
+
+        // particles are stepped in parallel, dead ones are respawned serially
+        // afterwards and go onto the rails when enabled. Planets don't move
+        // during the particle pass, so their grid is shared by all workers.
+        BuildPlanetGrid();
+        std::atomic<int> absorbed(0), scattered(0);
+        auto hitPlanets = [&](Vector2& pos, Vector2& vel) {
+            PlanetHit hit = HitPlanets(pos, vel);
+            if (hit == PLANET_ABSORBED) absorbed.fetch_add(1, std::memory_order_relaxed);
+            if (hit == PLANET_SCATTERED) scattered.fetch_add(1, std::memory_order_relaxed);
+            return hit != PLANET_ABSORBED;
+        };
+
+        if (useCompactLayout) {
+            ParallelStep(compactParticles.size(), [&](size_t i) {
+                CompactParticle& cp = compactParticles[i];
+                if (!cp.active) return false;
+                Vector2 pos = cp.Position(position);
+                Vector2 vel = cp.Velocity();
+                float lifetime = cp.Lifetime();
+                bool alive = StepParticle(pos, vel, lifetime, dt) && hitPlanets(pos, vel);
+                cp.Pack(pos, vel, lifetime, position);
+                if (!alive) cp.active = 0;
+                return cp.active != 0;
+            });
+
+            for (size_t k = respawnIndices.size(); k-- > 0;) {
+                size_t i = respawnIndices[k];
+                Particle fresh;
+                fresh.Reset(rng);
+                if (useRails && AddToRails(fresh)) {
+                    compactParticles[i] = compactParticles.back();
+                    compactParticles.pop_back();
+                    continue;
+                }
+                compactParticles[i].Pack(fresh.position, fresh.velocity, fresh.lifetime, position);
             }
+        }
+
+        // gravity runs on the pool 4 particles at a time, then the horizon
+        // and the planets are checked one by one while the chunk is in cache
+        const PointGravityForce<AccretionLayout> gravity = Gravity(dt);
+        const EulerIntegrator<AccretionLayout> integrator(dt);
+        float* x = particles[AccretionLayout::X].data();
+        float* y = particles[AccretionLayout::Y].data();
+        float* vx = particles[AccretionLayout::VELOCITY_X].data();
+        float* vy = particles[AccretionLayout::VELOCITY_Y].data();
+        float* lifetime = particles[AccretionLayout::LIFETIME].data();
+        ParallelStep(particles.Size(), [&](size_t begin, size_t end) {
+            particles.Step(begin, end, 1, gravity, integrator);
+        }, [&](size_t i) {
+            Vector2 pos = { x[i], y[i] };
+            Vector2 vel = { vx[i], vy[i] };
+            bool alive = Swallow(pos, lifetime[i], dt) && hitPlanets(pos, vel);
+            x[i] = pos.x;
+            y[i] = pos.y;
+            vx[i] = vel.x;
+            vy[i] = vel.y;
+            return alive;
+        });
+        collisionStats.particlesAbsorbed = absorbed.load();
+        collisionStats.particlesScattered = scattered.load();
 
-            if (dist < eventHorizonRadius || particle.lifetime <= 0) {
-                particle.active = false;
+        for (size_t k = respawnIndices.size(); k-- > 0;) {
+            size_t i = respawnIndices[k];
+            Particle fresh;
+            fresh.Reset(rng);
+            if (useRails && AddToRails(fresh)) {
+                particles.Remove(i);
+                continue;
             }
+            StoreParticle(i, fresh);
+        }
 
-            float speed = sqrt(particle.velocity.x * particle.velocity.x +
-                particle.velocity.y * particle.velocity.y);
-            float redShift = std::min(speed / 200.0f, 1.0f);
-            particle.color.r = 255;
-            particle.color.g = (unsigned char)(255 * (1.0f - redShift * 0.7f));
-            particle.color.b = (unsigned char)(255 * (1.0f - redShift * 0.9f));
-            particle.color.a = (unsigned char)(255 * particle.lifetime);
+        if (rails.Size() > 0) {
+            UpdateRails(dt);
         }
 
         // Update planets
+        StepPlanetBodies(dt);
+        float criticalDistance = eventHorizonRadius * 3.0f;
         for (auto& planet : planets) {
             if (!planet.active) continue;
 
+            if (planet.onConic) {
+                Vector2 relative, velocity;
+                planet.orbit.Propagate(time, relative, velocity);
+                planet.position = { position.x + relative.x, position.y + relative.y };
+                planet.velocity = velocity;
+
+                // hand over to the integrator before the tidal zone is reached
+                float r = sqrt(relative.x * relative.x + relative.y * relative.y);
+                if (r < criticalDistance * KEPLER_EXIT_FACTOR) planet.onConic = false;
+                // the lattice rests on a conic, this only catches up with a
+                // stretch the planet brought along
+                Vector2 inward = { -relative.x / r, -relative.y / r };
+                ShedDebris(planet, inward, ShedFraction(planet, r, inward, dt));
+                continue;
+            }
+
             Vector2 toCenter = {
                 position.x - planet.position.x,
                 position.y - planet.position.y
@@ -193,15 +641,16 @@ public:
                 toCenter.y / dist
             };
 
-            float tidalForce = 6000.0f / (dist * dist * dist);
-            float criticalDistance = eventHorizonRadius * 3.0f;
-            
-            if (dist < criticalDistance) {
-                float distanceFactor = (criticalDistance - dist) / criticalDistance;
-                planet.stretchFactor = 1.0f + (tidalForce * distanceFactor * 5.0f);
-                float width = planet.originalSize / sqrt(planet.stretchFactor);
-                planet.size = std::min(width, planet.originalSize);
+            // the lattice decides how far the planet is stretched; once it is
+            // all debris the planet is gone
+            ShedDebris(planet, direction, ShedFraction(planet, dist, direction, dt));
+            if (planet.shed >= 1.0f) {
+                planet.active = false;
+                continue;
             }
+            // what is left of the disc keeps shrinking as it sheds
+            float width = planet.originalSize / sqrt(planet.stretchFactor);
+            planet.size = std::min(width, planet.originalSize) * sqrtf(1.0f - planet.shed);
 
             float forceMagnitude = 3000.0f / (dist * dist);
             forceMagnitude *= planet.mass;
@@ -209,49 +658,431 @@ public:
             if (dist < eventHorizonRadius * 3.0f) {
                 float angle = atan2f(toCenter.y, toCenter.x);
                 float tangentialForce = forceMagnitude * 0.5f;
-                planet.velocity.x += -sinf(angle) * tangentialForce * GetFrameTime();
-                planet.velocity.y += cosf(angle) * tangentialForce * GetFrameTime();
+                planet.velocity.x += -sinf(angle) * tangentialForce * dt;
+                planet.velocity.y += cosf(angle) * tangentialForce * dt;
                 planet.rotation += forceMagnitude * 0.02f;
             }
 
-            planet.velocity.x += direction.x * forceMagnitude * GetFrameTime();
-            planet.velocity.y += direction.y * forceMagnitude * GetFrameTime();
+            planet.velocity.x += direction.x * forceMagnitude * dt;
+            planet.velocity.y += direction.y * forceMagnitude * dt;
+
+            planet.position.x += planet.velocity.x * dt;
+            planet.position.y += planet.velocity.y * dt;
 
-            planet.position.x += planet.velocity.x * GetFrameTime();
-            planet.position.y += planet.velocity.y * GetFrameTime();
+            // outside the tidal zone gravity is the only force (mu = 3000 * mass)
+            if (useKepler && dist > criticalDistance * KEPLER_ENTER_FACTOR) {
+                Vector2 relative = { planet.position.x - position.x, planet.position.y - position.y };
+                planet.onConic = planet.orbit.Init(relative, planet.velocity, 3000.0 * planet.mass, time);
+            }
 
             if (dist < eventHorizonRadius) {
                 planet.active = false;
-                int particleCount = static_cast<int>(40 * planet.stretchFactor);
-                for (int i = 0; i < particleCount; i++) {
-                    if (particles.size() < NUM_PARTICLES * 2) {
-                        Particle p;
-                        float offset = GetRandomFloat(-planet.originalSize * planet.stretchFactor, 
-                                                   planet.originalSize * planet.stretchFactor);
-                        p.position.x = planet.position.x + direction.x * offset;
-                        p.position.y = planet.position.y + direction.y * offset;
-                        p.color = planet.color;
-                        p.lifetime = 1.0f;
-                        
-                        float explosionAngle = GetRandomFloat(0, BLACK_HOLE_PI * 2);
-                        float explosionSpeed = GetRandomFloat(100, 300);
-                        p.velocity.x = cosf(explosionAngle) * explosionSpeed;
-                        p.velocity.y = sinf(explosionAngle) * explosionSpeed;
-                        particles.push_back(p);
-                    }
+                ShedDebris(planet, direction, 1.0f);
+            }
+        }
+        SpawnDebris();
+
+        CollidePlanets();
+
+        // swallowed and merged planets are removed, handles to them turn stale
+        for (size_t i = planets.Size(); i-- > 0;) {
+            if (!planets[i].active) planets.Remove(planets.HandleAt(i));
+        }
+    }
+
+private:
+    // rest of LoadState, the counterpart of the planet columns and the
+    // debris queue in SaveState
+    bool ReadPlanets(StateReader& reader) {
+        std::vector<uint32_t> planetIndex;
+        uint64_t planetCount;
+        if (!reader.ReadArray(planetIndex) || !reader.Read(planetCount) || planetCount > 1000000) return false;
+        planets.Values().resize(static_cast<size_t>(planetCount));
+        return planets.LoadIndex(planetIndex) &&
+            reader.ReadColumn(planets.Values(), [](Planet& p) -> Vector2& { return p.position; }) &&
+            reader.ReadColumn(planets.Values(), [](Planet& p) -> Vector2& { return p.velocity; }) &&
+            reader.ReadColumn(planets.Values(), [](Planet& p) -> float& { return p.size; }) &&
+            reader.ReadColumn(planets.Values(), [](Planet& p) -> float& { return p.mass; }) &&
+            reader.ReadColumn(planets.Values(), [](Planet& p) -> Color& { return p.color; }) &&
+            reader.ReadColumn(planets.Values(), [](Planet& p) -> bool& { return p.active; }) &&
+            reader.ReadColumn(planets.Values(), [](Planet& p) -> float& { return p.rotation; }) &&
+            reader.ReadColumn(planets.Values(), [](Planet& p) -> float& { return p.stretchFactor; }) &&
+            reader.ReadColumn(planets.Values(), [](Planet& p) -> float& { return p.originalSize; }) &&
+            reader.ReadColumn(planets.Values(), [](Planet& p) -> float& { return p.shed; }) &&
+            reader.ReadColumn(planets.Values(), [](Planet& p) -> bool& { return p.onConic; }) &&
+            reader.ReadColumn(planets.Values(), [](Planet& p) -> KeplerOrbit& { return p.orbit; }) &&
+            reader.ReadColumn(planets.Values(), [](Planet& p) -> SoftBodyState& { return p.body; }) &&
+            reader.ReadArray(debris.Bursts()) &&
+            reader.AtEnd();
+    }
+
+    // The hole's pull on free particles. It was tuned as a velocity kick of
+    // up to 50 px/s per (fixed) step, hence the division by dt.
+    PointGravityForce<AccretionLayout> Gravity(float dt) const {
+        return PointGravityForce<AccretionLayout>(position, 2000.0f / dt, 50.0f / dt);
+    }
+
+    // Gravity and spiral-in for a single compact particle, the same policies
+    // the pool runs. Returns false once the particle crossed the horizon or
+    // faded out.
+    bool StepParticle(Vector2& pos, Vector2& vel, float& lifetime, float dt) const {
+        float ax, ay;
+        Gravity(dt).Accelerate(pos.x, pos.y, ax, ay);
+        EulerIntegrator<AccretionLayout>(dt).Advance(pos.x, pos.y, vel.x, vel.y, ax, ay);
+        return Swallow(pos, lifetime, dt);
+    }
+
+    // Near the horizon a particle spirals in and fades. Returns false once
+    // it crossed the horizon or faded out.
+    bool Swallow(Vector2& pos, float& lifetime, float dt) const {
+        Vector2 toCenter = {
+            position.x - pos.x,
+            position.y - pos.y
+        };
+        float dist = sqrt(toCenter.x * toCenter.x + toCenter.y * toCenter.y);
+
+        if (dist < eventHorizonRadius * 1.5f) {
+            lifetime -= dt * 2.0f;
+
+            float angle = atan2f(toCenter.y, toCenter.x);
+            angle += dt * 5.0f;
+            float spiral_radius = std::max(dist * 0.95f, eventHorizonRadius);
+            pos.x = position.x - cosf(angle) * spiral_radius;
+            pos.y = position.y - sinf(angle) * spiral_radius;
+        }
+
+        return !(dist < eventHorizonRadius || lifetime <= 0);
+    }
+
+    // Overlapping planets merge into the heavier one, which keeps its handle.
+    // Mass and momentum are conserved, the area of the disc is too.
+    void CollidePlanets() {
+        BuildPlanetGrid();
+
+        collisionStats.planets = static_cast<int>(planets.Size());
+        collisionStats.overlaps = 0;
+        collisionStats.merges = 0;
+        collisionStats.candidatePairs = planetGrid.ForEachOverlappingPair([this](int i, int j) {
+            collisionStats.overlaps++;
+            Planet* a = &planets[i];
+            Planet* b = &planets[j];
+            if (!a->active || !b->active) return;
+            if (b->mass > a->mass) std::swap(a, b);
+            MergePlanet(*a, *b);
+            collisionStats.merges++;
+        });
+    }
+
+    // Grid items are the dense planet indices, inactive planets get radius 0
+    void BuildPlanetGrid() {
+        planetPositions.clear();
+        planetRadii.clear();
+        for (const auto& planet : planets) {
+            planetPositions.push_back(planet.position);
+            planetRadii.push_back(planet.active ? planet.size : 0.0f);
+        }
+        planetGrid.Build(planetPositions, planetRadii);
+    }
+
+    enum PlanetHit { PLANET_MISSED, PLANET_ABSORBED, PLANET_SCATTERED };
+
+    // A particle inside a planet is absorbed when it hits head on and bounces
+    // off the surface (in the planet's frame) when it only grazes it. Safe to
+    // call from the parallel particle pass, it only reads the planets.
+    PlanetHit HitPlanets(Vector2& pos, Vector2& vel) const {
+        PlanetHit result = PLANET_MISSED;
+        planetGrid.ForEachContaining(pos, [&](int i) {
+            if (result != PLANET_MISSED) return;
+            const Planet& planet = planets[i];
+            float dx = pos.x - planet.position.x;
+            float dy = pos.y - planet.position.y;
+            float dist = sqrtf(dx * dx + dy * dy);
+            if (dist < 1e-4f) {
+                result = PLANET_ABSORBED;
+                return;
+            }
+            Vector2 normal = { dx / dist, dy / dist };
+            Vector2 relative = { vel.x - planet.velocity.x, vel.y - planet.velocity.y };
+            float approach = relative.x * normal.x + relative.y * normal.y;
+            float speed = sqrtf(relative.x * relative.x + relative.y * relative.y);
+            if (approach >= 0.0f) return;  // already on the way out
+
+            if (-approach > speed * PLANET_GRAZE_COSINE) {
+                result = PLANET_ABSORBED;
+                return;
+            }
+            float impulse = (1.0f + PLANET_RESTITUTION) * approach;
+            vel.x -= impulse * normal.x;
+            vel.y -= impulse * normal.y;
+            pos.x = planet.position.x + normal.x * planet.size;
+            pos.y = planet.position.y + normal.y * planet.size;
+            result = PLANET_SCATTERED;
+        });
+        return result;
+    }
+
+    static void MergePlanet(Planet& into, Planet& other) {
+        float total = into.mass + other.mass;
+        float wa = into.mass / total;
+        float wb = other.mass / total;
+        into.position = { into.position.x * wa + other.position.x * wb, into.position.y * wa + other.position.y * wb };
+        into.velocity = { into.velocity.x * wa + other.velocity.x * wb, into.velocity.y * wa + other.velocity.y * wb };
+        into.mass = total;
+        into.size = sqrtf(into.size * into.size + other.size * other.size);
+        into.originalSize = sqrtf(into.originalSize * into.originalSize + other.originalSize * other.originalSize);
+        into.stretchFactor = std::max(into.stretchFactor, other.stretchFactor);
+        into.shed = into.shed * wa + other.shed * wb;
+        into.color.r = static_cast<unsigned char>(into.color.r * wa + other.color.r * wb);
+        into.color.g = static_cast<unsigned char>(into.color.g * wa + other.color.g * wb);
+        into.color.b = static_cast<unsigned char>(into.color.b * wa + other.color.b * wb);
+        into.onConic = false;  // new orbit, refitted on the next step
+        into.body.Reset(into.originalSize);
+        other.active = false;
+    }
+
+    // Calls step(i) for every particle on the shared pool and collects the
+    // indices it returns false for in ascending order. Chunks are fixed, so
+    // the respawn order (and with it the random sequence) doesn't depend on
+    // the thread count.
+    template <typename StepFn>
+    void ParallelStep(size_t count, const StepFn& step) {
+        ParallelStep(count, [](size_t, size_t) {}, step);
+    }
+
+    // The same, running chunk(begin, end) over each chunk first
+    template <typename ChunkFn, typename StepFn>
+    void ParallelStep(size_t count, const ChunkFn& chunk, const StepFn& step) {
+        size_t chunks = (count + STEP_GRAIN - 1) / STEP_GRAIN;
+        if (chunkRespawns.size() < chunks) chunkRespawns.resize(chunks);
+
+        // a call may cover several grains when ParallelFor runs inline
+        ThreadPool::Shared().ParallelFor(static_cast<int>(count), STEP_GRAIN, [&](int begin, int end) {
+            for (int grain = begin; grain < end; grain += STEP_GRAIN) {
+                const int grainEnd = std::min(grain + STEP_GRAIN, end);
+                std::vector<uint32_t>& dead = chunkRespawns[grain / STEP_GRAIN];
+                dead.clear();
+                chunk(static_cast<size_t>(grain), static_cast<size_t>(grainEnd));
+                for (int i = grain; i < grainEnd; i++) {
+                    if (!step(static_cast<size_t>(i))) dead.push_back(static_cast<uint32_t>(i));
                 }
             }
+        });
+
+        respawnIndices.clear();
+        for (size_t c = 0; c < chunks; c++) {
+            respawnIndices.insert(respawnIndices.end(), chunkRespawns[c].begin(), chunkRespawns[c].end());
+        }
+    }
+
+    // Deforms the lattice of every integrated planet in the hole's tidal
+    // field, all of them in one batch, and measures how far each is
+    // stretched. Planets on a conic are far from the hole and keep their
+    // lattice as it is, so they don't build up stretch that nothing sheds.
+    void StepPlanetBodies(float dt) {
+        bodyPlanets.clear();
+        for (size_t i = 0; i < planets.Size(); i++) {
+            if (planets[i].active && !planets[i].onConic) bodyPlanets.push_back(static_cast<int>(i));
+        }
+        const int count = static_cast<int>(bodyPlanets.size());
+        bodySolver.Resize(count);
+        for (int b = 0; b < count; b++) {
+            const Planet& planet = planets[bodyPlanets[b]];
+            Vector2 relative = { planet.position.x - position.x, planet.position.y - position.y };
+            bodySolver.Load(b, planet.body, planet.originalSize, relative, 3000.0f * planet.mass);
+        }
+        bodySolver.Step(dt, ThreadPool::Shared());
+        for (int b = 0; b < count; b++) {
+            Planet& planet = planets[bodyPlanets[b]];
+            bodySolver.Store(b, planet.body);
+            planet.stretchFactor = std::max(1.0f, bodySolver.Stretch(b));
+        }
+    }
+
+    // Fraction of the planet torn off after this step: none at rest, all
+    // of it once stretched to DISRUPTION_STRETCH. A planet that falls
+    // through the tidal zone faster than its lattice stretches also loses
+    // what is left in step with its fall, so it is gone by
+    // DISRUPTION_HORIZON horizon radii. Either way the debris comes off
+    // over many steps instead of at the horizon.
+    float ShedFraction(const Planet& planet, float dist, Vector2 inward, float dt) const {
+        float fraction = (planet.stretchFactor - 1.0f) / (DISRUPTION_STRETCH - 1.0f);
+        float fall = (planet.velocity.x * inward.x + planet.velocity.y * inward.y) * dt;
+        float left = dist - eventHorizonRadius * DISRUPTION_HORIZON;
+        if (dist < eventHorizonRadius * 3.0f && fall > 0.0f) {
+            float share = left > fall ? fall / left : 1.0f;
+            fraction = std::max(fraction, planet.shed + (1.0f - planet.shed) * share);
+        }
+        return std::min(fraction, 1.0f);
+    }
+
+    // Debris leaves along the line the planet is stretched into and keeps
+    // the planet's orbital velocity, so it trails off as a stream
+    static EmitterDesc DebrisEmitter(const Planet& planet, Vector2 direction) {
+        EmitterDesc desc;
+        desc.shape = EmitterDesc::SHAPE_LINE;
+        desc.extent = { planet.originalSize * planet.stretchFactor * 0.5f, 0 };
+        desc.axis = direction;
+        desc.velocity = EmitterDesc::VELOCITY_BOX;
+        desc.velocityMin = { -DEBRIS_SPREAD, -DEBRIS_SPREAD };
+        desc.velocityMax = { DEBRIS_SPREAD, DEBRIS_SPREAD };
+        desc.baseVelocity = planet.velocity;
+        desc.lifetimeMin = 1.0f;
+        desc.lifetimeMax = 1.0f;
+        return desc;
+    }
+
+    // Tidal disruption sheds the planet gradually, by ShedFraction().
+    // Shedding never goes back, a planet that escapes keeps what it has
+    // lost; whatever is left goes at the horizon (fraction 1).
+    void ShedDebris(Planet& planet, Vector2 direction, float fraction) {
+        float shed = std::max(planet.shed, std::min(fraction, 1.0f));
+        int count = static_cast<int>(shed * DEBRIS_PER_PLANET) - static_cast<int>(planet.shed * DEBRIS_PER_PLANET);
+        planet.shed = shed;
+        debris.Push(DebrisEmitter(planet, direction), planet.position, count);
+    }
+
+    // Debris that would take the particle count past twice the base count
+    // is dropped
+    void SpawnDebris() {
+        if (debris.Empty()) return;
+        const int room = baseParticleCount * 2 - static_cast<int>(ParticleCount());
+        debrisBatch.Clear();
+        debris.Drain(room < DEBRIS_SPAWN_BUDGET ? std::max(room, 0) : DEBRIS_SPAWN_BUDGET, rng, debrisBatch);
+        if (room <= DEBRIS_SPAWN_BUDGET) debris.Clear();
+        for (size_t i = 0; i < debrisBatch.Size(); i++) {
+            SpawnParticle({ debrisBatch.x[i], debrisBatch.y[i] },
+                { debrisBatch.velocityX[i], debrisBatch.velocityY[i] }, debrisBatch.lifetime[i]);
+        }
+    }
+
+    void SpawnParticle(const Particle& p) {
+        if (useCompactLayout) {
+            compactParticles.emplace_back();
+            compactParticles.back().Pack(p.position, p.velocity, p.lifetime, position);
+        }
+        else {
+            StoreParticle(particles.Add(), p);
+        }
+    }
+
+    Particle ParticleAt(size_t i) const {
+        Particle p;
+        p.position = { particles[AccretionLayout::X][i], particles[AccretionLayout::Y][i] };
+        p.velocity = { particles[AccretionLayout::VELOCITY_X][i], particles[AccretionLayout::VELOCITY_Y][i] };
+        p.mass = particles[AccretionLayout::MASS][i];
+        p.lifetime = particles[AccretionLayout::LIFETIME][i];
+        return p;
+    }
+
+    void StoreParticle(size_t i, const Particle& p) {
+        particles[AccretionLayout::X][i] = p.position.x;
+        particles[AccretionLayout::Y][i] = p.position.y;
+        particles[AccretionLayout::VELOCITY_X][i] = p.velocity.x;
+        particles[AccretionLayout::VELOCITY_Y][i] = p.velocity.y;
+        particles[AccretionLayout::MASS][i] = p.mass;
+        particles[AccretionLayout::LIFETIME][i] = p.lifetime;
+    }
+
+    void SpawnParticle(Vector2 pos, Vector2 vel, float lifetime) {
+        Particle p;
+        p.position = pos;
+        p.velocity = vel;
+        p.lifetime = lifetime;
+        SpawnParticle(p);
+    }
+
+    bool AddToRails(const Particle& p) {
+        return AddToRails(p.position, p.velocity, p.lifetime);
+    }
+
+    // Only orbits that are close to circular under Gravity() qualify: mostly
+    // tangential and within RAIL_SPEED_TOLERANCE of the circular speed. The
+    // particle then circles at the angular velocity the pull gives that
+    // radius, the radial part of its velocity is dropped.
+    bool AddToRails(Vector2 pos, Vector2 vel, float lifetime) {
+        float dx = pos.x - position.x;
+        float dy = pos.y - position.y;
+        float r = sqrt(dx * dx + dy * dy);
+        if (r < railInnerRadius) return false;
+
+        float radial = (vel.x * dx + vel.y * dy) / r;
+        float tangential = (vel.y * dx - vel.x * dy) / r;
+        if (fabsf(radial) > fabsf(tangential) * 0.25f) return false;
+
+        float circular = CircularSpeed(pos, r);
+        if (fabsf(fabsf(tangential) - circular) > circular * RAIL_SPEED_TOLERANCE) return false;
+
+        rails.Add(r, atan2f(dy, dx), (tangential < 0 ? -circular : circular) / r, lifetime);
+        return true;
+    }
+
+    // Speed of a circular orbit through pos under Gravity() at the fixed step
+    float CircularSpeed(Vector2 pos, float r) const {
+        float ax, ay;
+        Gravity(TimeWarp::FIXED_DT).Accelerate(pos.x, pos.y, ax, ay);
+        return sqrtf(sqrtf(ax * ax + ay * ay) * r);
+    }
+
+    void UpdateRails(float dt) {
+        rails.Advance(dt, railDrift);
+
+        std::vector<RailParticles::Perturber> perturbers;
+        for (const auto& planet : planets) {
+            if (!planet.active) continue;
+            perturbers.push_back({ planet.position, planet.size * 2.0f + railPerturbMargin });
         }
+
+        std::vector<Vector2> positions, velocities;
+        std::vector<float> lifetimes;
+        rails.Release(position, railInnerRadius, perturbers, railDrift, positions, velocities, lifetimes);
+        for (size_t i = 0; i < positions.size(); i++) {
+            SpawnParticle(positions[i], velocities[i], lifetimes[i]);
+        }
+    }
+
+    // Red shift is only evaluated here, so physics steps that are never
+    // drawn don't pay for it
+    template <typename Renderer>
+    void DrawParticleTrail(Renderer& renderer, Vector2 pos, Vector2 vel, float lifetime) const {
+        Color color = RedShiftColor(vel, lifetime);
+        Vector2 trail = {
+            pos.x - vel.x * 0.1f,
+            pos.y - vel.y * 0.1f
+        };
+        renderer.DrawLineV(pos, trail, ColorAlpha(color, color.a * 0.5f));
+    }
+
+    template <typename Renderer>
+    void DrawParticleGlow(Renderer& renderer, Vector2 pos, Vector2 vel, float lifetime) const {
+        renderer.SplatGlow(pos, 2.0f, RedShiftColor(vel, lifetime));
+    }
+
+public:
+    // Vertices the disk and particle layers submit, used to size the render batch
+    int EstimateDrawVertices() const {
+        int perParticle = ParticleRenderBatch::CIRCLE_VERTICES + ParticleRenderBatch::LINE_VERTICES;
+        return static_cast<int>(ParticleCount()) * perParticle +
+            static_cast<int>(accretionDisk.size()) * ParticleRenderBatch::CIRCLE_VERTICES;
     }
 
-    void Draw() {
-        DrawCircleGradient(position.x, position.y, radius * 4,
+    // Draws through raylib, using the dedicated batch for the geometry if given
+    void Draw(ParticleRenderBatch* batch = nullptr) const {
+        if (batch) batch->Begin(EstimateDrawVertices());
+        RaylibRenderer renderer(batch);
+        Draw(renderer);
+        if (batch) batch->End();
+    }
+
+    // Renderer is RaylibRenderer for the window or SoftwareRenderer headless
+    template <typename Renderer>
+    void Draw(Renderer& renderer) const {
+        renderer.DrawCircleGradient(position.x, position.y, radius * 4,
             ColorAlpha(BLACK, 0.2f), ColorAlpha(BLACK, 0.0f));
 
-        BeginBlendMode(BLEND_ADDITIVE);
+        renderer.BeginBlendMode(BLEND_ADDITIVE);
         for (size_t i = 0; i < accretionDisk.size(); i++) {
             float angle = (float)i * 2 * BLACK_HOLE_PI / DISK_SEGMENTS;
-            float brightness = (1.0f + sinf(angle * 3 + time * 2)) * 0.5f;
+            float brightness = (1.0f + sinf(angle * 3 + static_cast<float>(time) * 2)) * 0.5f;
 
             Vector2 point = accretionDisk[i];
             Vector2 screenPos = {
@@ -266,20 +1097,34 @@ public:
                 (unsigned char)(255 * brightness)
             };
 
-            DrawCircle(screenPos.x, screenPos.y, 2.0f, diskColor);
+            renderer.DrawCircle(screenPos.x, screenPos.y, 2.0f, diskColor);
         }
 
-        for (const auto& particle : particles) {
-            if (!particle.active) continue;
-
-            Vector2 trail = {
-                particle.position.x - particle.velocity.x * 0.1f,
-                particle.position.y - particle.velocity.y * 0.1f
-            };
+        // trails and heads in separate passes: additive blending makes the
+        // order irrelevant, and rlgl gets two long draw calls instead of a
+        // lines/quads switch per particle
+        for (size_t i = 0; i < particles.Size(); i++) {
+            const Particle particle = ParticleAt(i);
+            DrawParticleTrail(renderer, particle.position, particle.velocity, particle.lifetime);
+        }
+        for (const auto& cp : compactParticles) {
+            if (!cp.active) continue;
+            DrawParticleTrail(renderer, cp.Position(position), cp.Velocity(), cp.Lifetime());
+        }
+        for (size_t i = 0; i < rails.Size(); i++) {
+            DrawParticleTrail(renderer, rails.Position(i, position), rails.Velocity(i, railDrift), rails.lifetime[i]);
+        }
 
-            DrawLineV(particle.position, trail,
-                ColorAlpha(particle.color, particle.color.a * 0.5f));
-            DrawCircleV(particle.position, 2.0f, particle.color);
+        for (size_t i = 0; i < particles.Size(); i++) {
+            const Particle particle = ParticleAt(i);
+            DrawParticleGlow(renderer, particle.position, particle.velocity, particle.lifetime);
+        }
+        for (const auto& cp : compactParticles) {
+            if (!cp.active) continue;
+            DrawParticleGlow(renderer, cp.Position(position), cp.Velocity(), cp.Lifetime());
+        }
+        for (size_t i = 0; i < rails.Size(); i++) {
+            DrawParticleGlow(renderer, rails.Position(i, position), rails.Velocity(i, railDrift), rails.lifetime[i]);
         }
 
         //  spaghettification
@@ -304,55 +1149,804 @@ public:
                     planet.position.y + direction.y * offset
                 };
                 float atmosphereSize = planet.size * 1.2f * (1.0f - (i / planet.stretchFactor) * 0.3f);
-                DrawCircleGradient(pos.x, pos.y, atmosphereSize,
+                renderer.DrawCircleGradient(pos.x, pos.y, atmosphereSize,
                     ColorAlpha(planet.color, 0.1f), ColorAlpha(planet.color, 0.0f));
             }
 
-            //  stretched planet body
-            int segments = static_cast<int>(planet.stretchFactor * 10);
-            for (int i = 0; i < segments; i++) {
-                float t = static_cast<float>(i) / segments;
-                float offset = (t - 0.5f) * planet.originalSize * planet.stretchFactor;
-                Vector2 pos = {
-                    planet.position.x + direction.x * offset,
-                    planet.position.y + direction.y * offset
-                };
-                
-                float segmentSize = planet.size * (1.0f - powf(fabsf(t - 0.5f) * 2, 0.5f));
-                Color segmentColor = planet.color;
-                segmentColor.a = (unsigned char)(255 * (1.0f - powf(fabsf(t - 0.5f) * 2, 0.5f)));
-                
-                DrawCircle(pos.x, pos.y, segmentSize, segmentColor);
+            //  planet body, one blob per lattice node, fading towards the rim
+            for (int n = 0; n < SoftBodyState::NODES; n++) {
+                Vector2 rest = SoftBodyState::RestNode(n);
+                float rim = sqrtf(rest.x * rest.x + rest.y * rest.y);
+                float nodeSize = planet.size * 0.4f * (1.0f - rim * 0.3f);
+                Color nodeColor = ColorAlpha(planet.color, 1.0f - rim * 0.6f);
+                renderer.DrawCircle(planet.position.x + planet.body.x[n], planet.position.y + planet.body.y[n],
+                    nodeSize, nodeColor);
             }
         }
-        EndBlendMode();
+        renderer.EndBlendMode();
 
-        DrawCircleGradient(position.x, position.y, eventHorizonRadius,
+        renderer.DrawCircleGradient(position.x, position.y, eventHorizonRadius,
             BLACK, ColorAlpha(BLACK, 0.0f));
-        DrawCircle(position.x, position.y, radius * 0.5f, BLACK);
+        renderer.DrawCircle(position.x, position.y, radius * 0.5f, BLACK);
+    }
+};
+
+// Runs the simulation headless with each particle layout and prints
+// throughput. Rails only take particles on circular orbits, which the
+// spawned disk has none of, so full and rails are also compared on a disk
+// launched at the circular speed: the same physics either way.
+void RunLayoutBenchmark(int particleCount, int steps) {
+    const float dt = 1.0f / 60.0f;
+    printf("Particle layout benchmark: %d particles, %d steps\n", particleCount, steps);
+
+    const char* names[] = { "full", "compact", "rails", "full, circular", "rails, circular" };
+    const int layouts[] = { 0, 1, 2, 0, 2 };  // full, compact, rails
+    for (int run = 0; run < 5; run++) {
+        const int layout = layouts[run];
+        BlackHole blackHole(particleCount);
+        if (run >= 3) blackHole.CircularizeParticles();
+        blackHole.SetCompactLayout(layout == 1);
+        blackHole.SetOnRails(layout == 2);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < steps; i++) {
+            blackHole.Update(dt);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        double rate = static_cast<double>(particleCount) * steps / elapsed.count() / 1e6;
+        int bytes = layout == 1 ? static_cast<int>(sizeof(CompactParticle)) :
+            layout == 2 ? static_cast<int>(4 * sizeof(float)) : static_cast<int>(AccretionLayout::COLUMNS * sizeof(float));
+        printf("  %-16s %2d bytes/particle  %8.2f Mparticle-steps/s  %zu on rails\n", names[run], bytes, rate,
+            blackHole.RailCount());
+    }
+}
+
+// Scatters planets over a large field and times the steps, to show that the
+// collision broadphase stays near linear in the planet count
+void RunPlanetBenchmark(int planetCount, int steps) {
+    const float dt = 1.0f / 60.0f;
+    printf("Planet collision benchmark: %d planets, %d steps\n", planetCount, steps);
+
+    BlackHole blackHole(0);
+    Random rng(99);
+    float extent = sqrtf(static_cast<float>(planetCount)) * 150.0f;
+    for (int i = 0; i < planetCount; i++) {
+        Vector2 pos = { SCREEN_WIDTH / 2 + rng.GetFloat(-extent, extent), SCREEN_HEIGHT / 2 + rng.GetFloat(-extent, extent) };
+        blackHole.AddPlanet(pos);
+    }
+
+    long long candidates = 0;
+    int merges = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; i++) {
+        blackHole.Update(dt);
+        candidates += blackHole.CollisionStats().candidatePairs;
+        merges += blackHole.CollisionStats().merges;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double bruteForce = 0.5 * planetCount * (planetCount - 1.0);
+    printf("  %.3f ms/step, %.0f candidate pairs/step (brute force %.0f), %d merges, %d planets left\n",
+        elapsed.count() * 1000.0 / steps, static_cast<double>(candidates) / steps, bruteForce, merges,
+        static_cast<int>(blackHole.PlanetCount()));
+}
+
+// Times fire frames with every substep streamed over the whole pool against
+// the temporally blocked path, and checks that both end in the same state.
+// Constraints and heat transfer are off so only the integration is measured.
+void RunFireBenchmark(int particleCount, int frames) {
+    const float dt = 1.0f / 60.0f;
+    printf("Fire Verlet benchmark: %d particles, %d frames\n", particleCount, frames);
+
+    FireParticleSystem initial({ SCREEN_WIDTH / 2, SCREEN_HEIGHT - 50 }, particleCount);
+    for (int i = 0; i < particleCount; i++) {
+        initial.addParticle();
+    }
+
+    const char* names[] = { "per substep", "fused" };
+    std::vector<FireParticle> results[2];
+    for (int fused = 0; fused < 2; fused++) {
+        FireParticleSystem fire = initial;
+        fire.setSubstepFusion(fused == 1);
+        fire.setConstraintIterations(0);
+        fire.setHeatTransferMode(FireParticleSystem::HEAT_NONE);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            fire.update(dt);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        for (size_t p = 0; p < fire.particleCount(); p++) {
+            results[fused].push_back(fire.getParticle(p));
+        }
+        double rate = static_cast<double>(particleCount) * frames / elapsed.count() / 1e6;
+        printf("  %-12s %8.3f ms/frame  %8.2f Mparticle-frames/s\n", names[fused],
+            elapsed.count() * 1000.0 / frames, rate);
+    }
+
+    bool same = results[0].size() == results[1].size();
+    for (size_t p = 0; same && p < results[0].size(); p++) {
+        same = memcmp(&results[0][p].position, &results[1][p].position, sizeof(Vector2)) == 0 &&
+            memcmp(&results[0][p].oldPosition, &results[1][p].oldPosition, sizeof(Vector2)) == 0 &&
+            results[0][p].temperature == results[1][p].temperature;
+    }
+    printf("  results %s\n", same ? "identical" : "DIFFER");
+}
+
+// Times solveConstraints() on pools of 1 to 32 threads. The solver is Jacobi
+// with per-particle gathers, so every thread count must give the same bits.
+void RunConstraintBenchmark(int particleCount, int repeats) {
+    printf("Fire constraint benchmark: %d particles, %d solves\n", particleCount, repeats);
+
+    // one particle per 50 px^2, about 1.5 per PARTICLE_SPACING disk
+    float extent = sqrtf(static_cast<float>(particleCount) * 50.0f) * 0.5f;
+    FireParticleSystem initial({ SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 }, particleCount);
+    initial.setEmitterExtent({ extent, extent });
+    for (int i = 0; i < particleCount; i++) {
+        initial.addParticle();
+    }
+
+    std::vector<FireParticle> reference;
+    double baseline = 0.0;
+    const int threadCounts[] = { 1, 2, 4, 8, 16, 32 };
+    for (int threadCount : threadCounts) {
+        ThreadPool pool(threadCount);
+        FireParticleSystem fire = initial;
+        fire.setThreadPool(&pool);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeats; i++) {
+            fire.solveConstraints();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double ms = elapsed.count() * 1000.0 / repeats;
+        if (threadCount == 1) baseline = ms;
+
+        bool same = true;
+        for (size_t p = 0; p < fire.particleCount(); p++) {
+            FireParticle particle = fire.getParticle(p);
+            if (threadCount == 1) reference.push_back(particle);
+            else same = same && memcmp(&particle.position, &reference[p].position, sizeof(Vector2)) == 0;
+        }
+        printf("  %2d threads %8.3f ms/solve  speedup %5.2fx  %s\n", threadCount, ms, baseline / ms,
+            same ? "identical" : "DIFFERS");
+    }
+    printf("  (%u hardware threads)\n", std::thread::hardware_concurrency());
+}
+
+// Times both heat transfer modes on the same particles, once spread out and
+// once packed 16 times denser. The grid mode's cost depends on the particle
+// and node counts only; the pairwise mode pays for every neighbour.
+void RunHeatBenchmark(int particleCount, int repeats) {
+    const float dt = 1.0f / 60.0f;
+    printf("Fire heat transfer benchmark: %d particles, %d transfers\n", particleCount, repeats);
+
+    const float densities[] = { 50.0f, 50.0f / 16.0f };  // px^2 per particle
+    for (float area : densities) {
+        float extent = sqrtf(static_cast<float>(particleCount) * area) * 0.5f;
+        FireParticleSystem initial({ SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 }, particleCount);
+        initial.setEmitterExtent({ extent, extent });
+        for (int i = 0; i < particleCount; i++) {
+            initial.addParticle();
+        }
+
+        const char* names[] = { "pairwise", "grid" };
+        const FireParticleSystem::HeatTransferMode modes[] = {
+            FireParticleSystem::HEAT_PAIRWISE, FireParticleSystem::HEAT_GRID
+        };
+        for (int m = 0; m < 2; m++) {
+            FireParticleSystem fire = initial;
+            fire.setHeatTransferMode(modes[m]);
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < repeats; i++) {
+                fire.transferHeat(dt);
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            printf("  %6.1f px^2/particle  %-8s %8.3f ms/transfer\n", area, names[m],
+                elapsed.count() * 1000.0 / repeats);
+        }
+    }
+}
+
+// Updates a field of small fires, once as separate systems and once sharing a
+// pool, with and without viewport culling. Rows are far enough apart that the
+// flames don't touch, so every variant does the same work; the viewport is
+// one screen in the corner of the field. Nothing is drawn: this runs before
+// the window exists, so it times the update and the culling only.
+void RunEmitterBenchmark(int emitterCount, int frames) {
+    const float dt = 1.0f / 60.0f;
+    const float spacingX = 80.0f;
+    const float spacingY = FireParticleSystem::FLAME_REACH + 50.0f;
+    const int budget = FireParticleSystem::DEFAULT_MAX_PARTICLES;
+    const int columns = std::max(1, static_cast<int>(sqrtf(emitterCount * 6.0f)));
+    auto emitterPosition = [&](int e) {
+        return Vector2{ spacingX * (e % columns + 0.5f), spacingY * (e / columns + 1.0f) };
+    };
+    printf("Fire emitter benchmark: %d emitters of %d particles, %d frames\n", emitterCount, budget, frames);
+
+    {
+        std::vector<FireParticleSystem> fires;
+        fires.reserve(emitterCount);
+        for (int e = 0; e < emitterCount; e++) {
+            fires.emplace_back(emitterPosition(e), budget, e + 1);
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            for (FireParticleSystem& fire : fires) {
+                fire.update(dt);
+            }
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        size_t particles = 0;
+        for (const FireParticleSystem& fire : fires) {
+            particles += fire.particleCount();
+        }
+        printf("  separate systems %8.3f ms/frame  %zu particles\n", elapsed.count() * 1000.0 / frames, particles);
+    }
+
+    for (int cull = 0; cull < 2; cull++) {
+        FireParticleSystem fire;
+        std::vector<FireEmitterHandle> handles;
+        for (int e = 0; e < emitterCount; e++) {
+            handles.push_back(fire.addEmitter(emitterPosition(e), budget));
+        }
+        if (cull) fire.setViewport({ 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT });
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            fire.update(dt);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        int visible = 0;
+        for (FireEmitterHandle handle : handles) {
+            visible += fire.getEmitter(handle)->visible ? 1 : 0;
+        }
+        printf("  shared pool%-5s %8.3f ms/frame  %zu particles, %d emitters visible\n", cull ? ", cull" : "",
+            elapsed.count() * 1000.0 / frames, fire.particleCount(), visible);
+    }
+}
+
+// Steps a square fluid grid heated by a fixed patch of points at the bottom,
+// for a few pressure iteration counts. The residual is the divergence left
+// after the projection.
+void RunFluidBenchmark(int cells, int steps) {
+    const float dt = 1.0f / 60.0f;
+    const float cellSize = 4.0f;
+    printf("Fire fluid benchmark: %dx%d cells, %d steps on %d threads\n", cells, cells, steps,
+        ThreadPool::Shared().ThreadCount());
+
+    std::vector<float> x, y, t;
+    for (int i = 0; i < 4096; i++) {
+        x.push_back(cells * cellSize * 0.5f + (i % 64 - 32) * 0.5f);
+        y.push_back(cells * cellSize * 0.8f + (i / 64) * 0.5f);
+        t.push_back(1500.0f);
+    }
+
+    const int iterationCounts[] = { 10, 40, 160 };
+    for (int iterations : iterationCounts) {
+        FluidGrid fluid;
+        fluid.Resize(0, 0, cells, cells, cellSize, 300.0f);
+        fluid.SetPressureIterations(iterations);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < steps; i++) {
+            fluid.AddTemperature(x.data(), y.data(), t.data(), static_cast<int>(t.size()), 0.5f);
+            fluid.Step(dt, ThreadPool::Shared());
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        printf("  %3d iterations %8.3f ms/step  residual %.5f\n", iterations,
+            elapsed.count() * 1000.0 / steps, fluid.Divergence());
+    }
+}
+
+// Generates particles the way planet debris used to be spawned, one at a
+// time with cos/sin per particle, and in batches from an EmitterDesc. Then
+// bursts a field of fires with and without a spawn budget and reports the
+// slowest frame.
+void RunSpawnBenchmark(int particleCount, int frames) {
+    const float dt = 1.0f / 60.0f;
+    printf("Spawn benchmark: %d particles\n", particleCount);
+
+    EmitterDesc desc;
+    desc.shape = EmitterDesc::SHAPE_LINE;
+    desc.extent = { 60.0f, 0.0f };
+    desc.axis = { 0.6f, 0.8f };
+    desc.velocity = EmitterDesc::VELOCITY_RADIAL;
+    desc.speedMin = 100.0f;
+    desc.speedMax = 300.0f;
+    desc.lifetimeMin = 1.0f;
+    desc.lifetimeMax = 1.0f;
+    const Vector2 origin = { SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 };
+
+    // best of a few runs, so first-touch allocation isn't measured
+    const int runs = 5;
+    double scalarTime = 1e30, batchTime = 1e30;
+    std::vector<Particle> spawned;
+    SpawnBatch batch;
+    for (int run = 0; run < runs; run++) {
+        Random rng(1);
+        spawned.clear();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < particleCount; i++) {
+            Particle p;
+            float offset = rng.GetFloat(-desc.extent.x, desc.extent.x);
+            p.position = { origin.x + desc.axis.x * offset, origin.y + desc.axis.y * offset };
+            p.lifetime = 1.0f;
+            float angle = rng.GetFloat(0, BLACK_HOLE_PI * 2);
+            float speed = rng.GetFloat(desc.speedMin, desc.speedMax);
+            p.velocity = { cosf(angle) * speed, sinf(angle) * speed };
+            spawned.push_back(p);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        scalarTime = std::min(scalarTime, elapsed.count());
+
+        batch.Clear();
+        start = std::chrono::steady_clock::now();
+        GenerateSpawns(desc, origin, particleCount, rng, batch);
+        elapsed = std::chrono::steady_clock::now() - start;
+        batchTime = std::min(batchTime, elapsed.count());
+    }
+    printf("  one at a time    %8.3f ns/particle\n", scalarTime * 1e9 / particleCount);
+    printf("  batched          %8.3f ns/particle\n", batchTime * 1e9 / particleCount);
+
+    const int emitterCount = 100;
+    const int budgets[] = { 0, std::max(particleCount / 30, 1) };
+    for (int budget : budgets) {
+        FireParticleSystem fire;
+        fire.setSpawnBudget(budget);
+        std::vector<FireEmitterHandle> handles;
+        for (int e = 0; e < emitterCount; e++) {
+            EmitterDesc flame = FireParticleSystem::flameEmitter(particleCount / emitterCount);
+            flame.rate = 0;
+            handles.push_back(fire.addEmitter({ 60.0f * (e % 20), 300.0f * (e / 20 + 1) }, flame,
+                particleCount / emitterCount));
+        }
+        for (FireEmitterHandle handle : handles) {
+            fire.burst(handle, particleCount / emitterCount);
+        }
+        double slowest = 0, total = 0;
+        for (int i = 0; i < frames; i++) {
+            auto start = std::chrono::steady_clock::now();
+            fire.update(dt);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            slowest = std::max(slowest, elapsed.count());
+            total += elapsed.count();
+        }
+        printf("  fire burst, budget %-7d slowest frame %8.3f ms, mean %8.3f ms\n", budget,
+            slowest * 1000.0, total * 1000.0 / frames);
+    }
+}
+
+// Deforms a field of planet lattices held at distances from 30 to 300 px of
+// the hole, all in one batch and one planet at a time, and checks that both
+// end in the same shape
+void RunSoftBodyBenchmark(int planetCount, int steps) {
+    const float dt = 1.0f / 60.0f;
+    printf("Soft body benchmark: %d planets, %d steps on %d threads\n", planetCount, steps,
+        ThreadPool::Shared().ThreadCount());
+
+    std::vector<SoftBodyState> bodies(planetCount);
+    std::vector<Vector2> relative(planetCount);
+    for (int i = 0; i < planetCount; i++) {
+        float distance = 30.0f + 270.0f * i / std::max(planetCount - 1, 1);
+        float angle = 2.39996f * i;
+        relative[i] = { cosf(angle) * distance, sinf(angle) * distance };
+        bodies[i].Reset(30.0f);
+    }
+    const float gm = 3000.0f * 60.0f;
+
+    std::vector<SoftBodyState> batched = bodies;
+    std::vector<float> stretch(planetCount);
+    SoftBodySolver solver;
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < steps; s++) {
+        solver.Resize(planetCount);
+        for (int i = 0; i < planetCount; i++) solver.Load(i, batched[i], 30.0f, relative[i], gm);
+        solver.Step(dt, ThreadPool::Shared());
+        for (int i = 0; i < planetCount; i++) solver.Store(i, batched[i]);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    for (int i = 0; i < planetCount; i++) stretch[i] = solver.Stretch(i);
+    printf("  batched      %8.3f ms/step  %7.3f us/planet\n", elapsed.count() * 1000.0 / steps,
+        elapsed.count() * 1e6 / (static_cast<double>(steps) * planetCount));
+
+    std::vector<SoftBodyState> single = bodies;
+    start = std::chrono::steady_clock::now();
+    for (int s = 0; s < steps; s++) {
+        for (int i = 0; i < planetCount; i++) {
+            solver.Resize(1);
+            solver.Load(0, single[i], 30.0f, relative[i], gm);
+            solver.Step(dt, ThreadPool::Shared());
+            solver.Store(0, single[i]);
+        }
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+    bool same = memcmp(batched.data(), single.data(), sizeof(SoftBodyState) * planetCount) == 0;
+    printf("  one by one   %8.3f ms/step  %7.3f us/planet  %s\n", elapsed.count() * 1000.0 / steps,
+        elapsed.count() * 1e6 / (static_cast<double>(steps) * planetCount), same ? "same shapes" : "SHAPES DIFFER");
+
+    for (int i = 0; i < planetCount; i += std::max(planetCount / 6, 1)) {
+        float distance = sqrtf(relative[i].x * relative[i].x + relative[i].y * relative[i].y);
+        printf("  %5.0f px  stretch %.3f\n", distance, stretch[i]);
+    }
+}
+
+// Simulates a number of frames and writes a preview image using the CPU
+// rasterizer, no window or GPU required
+int RenderPreview(const char* fileName, int frames, float scale, int particleCount) {
+    const float dt = 1.0f / 60.0f;
+    BlackHole blackHole(particleCount);
+    for (int i = 0; i < frames; i++) {
+        blackHole.Update(dt);
+    }
+
+    SoftwareRenderer renderer(static_cast<int>(SCREEN_WIDTH * scale),
+        static_cast<int>(SCREEN_HEIGHT * scale), scale);
+    renderer.SetToneMapping(SoftwareRenderer::TONEMAP_SOFT_CLIP);
+
+    auto start = std::chrono::steady_clock::now();
+    GravitationalLens lens;
+    blackHole.UpdateLens(lens, renderer.Width(), renderer.Height(), scale);
+
+    renderer.Clear(BLACK);
+    blackHole.Draw(renderer);
+    renderer.Flush();
+    lens.Apply(renderer);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    bool ok = renderer.Export(fileName);
+    printf("%s %dx%d preview to %s (rasterized in %.2f ms on %d threads)\n",
+        ok ? "Wrote" : "Failed to write", renderer.Width(), renderer.Height(), fileName,
+        elapsed.count() * 1000.0, ThreadPool::Shared().ThreadCount());
+    return ok ? 0 : 1;
+}
+
+// Runs the timeline (and with it BlackHole::Update) on its own thread. Every
+// displayed frame posts the input gathered by the window and draws the newest
+// finished frame, so simulating frame N + 1 overlaps drawing frame N and the
+// frame time approaches max(simulate, draw) instead of their sum.
+class SimulationThread {
+public:
+    // Window input for one displayed frame. Inputs posted while the
+    // simulation is still busy are merged.
+    struct Input {
+        float frameTime = 0;
+        int warpChange = 0;
+        bool toggleScrub = false;
+        int64_t seekSteps = 0;
+        float seekFraction = -1.0f;  // position on the timeline bar, < 0 for none
+
+        void Merge(const Input& later) {
+            frameTime += later.frameTime;
+            warpChange += later.warpChange;
+            toggleScrub = toggleScrub != later.toggleScrub;
+            seekSteps += later.seekSteps;
+            if (later.seekFraction >= 0) seekFraction = later.seekFraction;
+        }
+    };
+
+    // A published copy of the black hole plus what the overlay shows
+    struct Frame {
+        BlackHole blackHole;
+        int64_t current = 0;
+        int64_t head = 0;
+        int64_t earliest = 0;
+        bool scrubbing = false;
+        int keyframeCount = 0;
+        size_t keyframeBytes = 0;
+        int warpFactor = 1;
+        double achievedRate = 0;
+        double simulateMilliseconds = 0;
+    };
+
+    SimulationThread() :
+        timeline(blackHole, TimeWarp::FIXED_DT),
+        hasInput(false),
+        stopping(false) {
+        Publish(0);
+        thread = std::thread(&SimulationThread::Run, this);
+    }
+
+    ~SimulationThread() {
+        {
+            std::lock_guard<std::mutex> lock(inboxMutex);
+            stopping = true;
+        }
+        inboxReady.notify_one();
+        thread.join();
+    }
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    void Post(Input input) {
+        {
+            std::lock_guard<std::mutex> lock(inboxMutex);
+            if (hasInput) inbox.Merge(input);
+            else inbox = std::move(input);
+            hasInput = true;
+        }
+        inboxReady.notify_one();
+    }
+
+    // Queues a command for the start of the next live step. Safe from any
+    // thread and never blocks; returns false if the queue is full.
+    bool Submit(const SimCommand& command) { return commands.TryPush(command); }
+
+    // Swaps in the newest published frame, if there is one
+    void AcquireFrame() { frames.Acquire(); }
+    const Frame& CurrentFrame() const { return frames.Front(); }
+
+private:
+    // owned by the simulation thread after construction
+    BlackHole blackHole;
+    TimeWarp timeWarp;
+    Timeline<BlackHole, SimCommand> timeline;
+
+    MpscQueue<SimCommand> commands;
+    TripleBuffer<Frame> frames;
+
+    // the inbox only paces the simulation, frames are handed over lock-free
+    std::mutex inboxMutex;
+    std::condition_variable inboxReady;
+    Input inbox;
+    bool hasInput;
+    bool stopping;
+    std::thread thread;
+
+    void Run() {
+        for (;;) {
+            Input input;
+            {
+                std::unique_lock<std::mutex> lock(inboxMutex);
+                inboxReady.wait(lock, [this] { return stopping || hasInput; });
+                if (stopping) return;
+                input = std::move(inbox);
+                inbox = Input();
+                hasInput = false;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            Process(input);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            Publish(elapsed.count() * 1000.0);
+        }
+    }
+
+    void Process(const Input& input) {
+        for (int i = 0; i < input.warpChange; i++) timeWarp.Faster();
+        for (int i = 0; i > input.warpChange; i--) timeWarp.Slower();
+
+        if (input.toggleScrub) {
+            if (timeline.IsScrubbing()) timeline.Resume();
+            else timeline.Seek(timeline.Current());
+        }
+
+        if (timeline.IsScrubbing()) {
+            if (input.seekSteps != 0) {
+                timeline.Seek(timeline.Current() + input.seekSteps);
+            }
+            if (input.seekFraction >= 0) {
+                int64_t first = timeline.Earliest();
+                timeline.Seek(first + static_cast<int64_t>(input.seekFraction * static_cast<double>(timeline.Head() - first) + 0.5));
+            }
+            return;
+        }
+
+        // queued commands are drained at the start of each step and go through
+        // the timeline so they can be replayed; while scrubbing they wait.
+        // Only the state after the last step of the frame is published.
+        timeWarp.Advance(input.frameTime, [this](float) {
+            SimCommand command;
+            while (commands.TryPop(command)) timeline.Submit(command);
+            timeline.Step();
+        });
+    }
+
+    void Publish(double simulateMilliseconds) {
+        Frame& frame = frames.Back();
+        frame.blackHole = blackHole;
+        frame.current = timeline.Current();
+        frame.head = timeline.Head();
+        frame.earliest = timeline.Earliest();
+        frame.scrubbing = timeline.IsScrubbing();
+        frame.keyframeCount = static_cast<int>(timeline.Keyframes().Count());
+        frame.keyframeBytes = timeline.Keyframes().MemoryBytes();
+        frame.warpFactor = timeWarp.Factor();
+        frame.achievedRate = timeWarp.AchievedRate();
+        frame.simulateMilliseconds = simulateMilliseconds;
+        frames.Publish();
     }
 };
 
-int main() {
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench-layout") == 0) {
+            int count = (i + 1 < argc) ? atoi(argv[i + 1]) : 1000000;
+            RunLayoutBenchmark(count > 0 ? count : 1000000, 300);
+            return 0;
+        }
+        if (strcmp(argv[i], "--bench-planets") == 0) {
+            int count = (i + 1 < argc) ? atoi(argv[i + 1]) : 5000;
+            RunPlanetBenchmark(count > 0 ? count : 5000, 120);
+            return 0;
+        }
+        if (strcmp(argv[i], "--bench-fire") == 0) {
+            int count = (i + 1 < argc) ? atoi(argv[i + 1]) : 1000000;
+            RunFireBenchmark(count > 0 ? count : 1000000, 120);
+            return 0;
+        }
+        if (strcmp(argv[i], "--bench-constraints") == 0) {
+            int count = (i + 1 < argc) ? atoi(argv[i + 1]) : 200000;
+            RunConstraintBenchmark(count > 0 ? count : 200000, 10);
+            return 0;
+        }
+        if (strcmp(argv[i], "--bench-heat") == 0) {
+            int count = (i + 1 < argc) ? atoi(argv[i + 1]) : 200000;
+            RunHeatBenchmark(count > 0 ? count : 200000, 10);
+            return 0;
+        }
+        if (strcmp(argv[i], "--bench-emitters") == 0) {
+            int count = (i + 1 < argc) ? atoi(argv[i + 1]) : 1000;
+            RunEmitterBenchmark(count > 0 ? count : 1000, 120);
+            return 0;
+        }
+        if (strcmp(argv[i], "--bench-fluid") == 0) {
+            int cells = (i + 1 < argc) ? atoi(argv[i + 1]) : 128;
+            RunFluidBenchmark(cells > 0 ? cells : 128, 120);
+            return 0;
+        }
+        if (strcmp(argv[i], "--bench-spawn") == 0) {
+            int count = (i + 1 < argc) ? atoi(argv[i + 1]) : 100000;
+            RunSpawnBenchmark(count > 0 ? count : 100000, 60);
+            return 0;
+        }
+        if (strcmp(argv[i], "--bench-softbody") == 0) {
+            int count = (i + 1 < argc) ? atoi(argv[i + 1]) : 1000;
+            RunSoftBodyBenchmark(count > 0 ? count : 1000, 120);
+            return 0;
+        }
+        if (strcmp(argv[i], "--render-preview") == 0 && i + 1 < argc) {
+            int frames = (i + 2 < argc) ? atoi(argv[i + 2]) : 120;
+            float scale = (i + 3 < argc) ? static_cast<float>(atof(argv[i + 3])) : 1.0f;
+            int count = (i + 4 < argc) ? atoi(argv[i + 4]) : BlackHole::NUM_PARTICLES;
+            return RenderPreview(argv[i + 1], std::max(frames, 0), scale > 0.0f ? scale : 1.0f,
+                count > 0 ? count : BlackHole::NUM_PARTICLES);
+        }
+    }
+
     InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Black Hole Simulation");
     SetTargetFPS(60);
 
-    BlackHole blackHole;
+    GravitationalLens lens;
+    RenderTexture2D sceneTarget = LoadRenderTexture(SCREEN_WIDTH, SCREEN_HEIGHT);
+    ParticleRenderBatch particleBatch;
+    SimulationThread simulation;
+    const Rectangle timelineBar = { 10, SCREEN_HEIGHT - 24, SCREEN_WIDTH - 20, 10 };
+    bool lensEnabled = true;
+    double drawMilliseconds = 0;
+    PlanetHandle tracked = PlanetHandle::Null();  // survives removals of other planets
 
     while (!WindowShouldClose()) {
-        if (IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
-            blackHole.AddPlanet(GetMousePosition());
+        simulation.AcquireFrame();
+        const SimulationThread::Frame& frame = simulation.CurrentFrame();
+        const BlackHole& blackHole = frame.blackHole;
+
+        SimulationThread::Input input;
+        input.frameTime = GetFrameTime();
+        if (!frame.scrubbing) {
+            Vector2 mouse = GetMousePosition();
+            if (IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
+                simulation.Submit(SimCommand::AddPlanet(mouse));
+            }
+            PlanetHandle hovered = blackHole.PlanetAt(mouse);
+            if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
+                if (IsKeyDown(KEY_M)) simulation.Submit(SimCommand::MoveHole(mouse));
+                else tracked = hovered;
+            }
+            if (!hovered.IsNull() && IsMouseButtonPressed(MOUSE_MIDDLE_BUTTON)) {
+                simulation.Submit(SimCommand::RemovePlanet(hovered));
+            }
+            float wheel = GetMouseWheelMove();
+            if (!hovered.IsNull() && wheel != 0.0f) {
+                float mass = blackHole.GetPlanet(hovered)->mass * powf(1.25f, wheel);
+                simulation.Submit(SimCommand::SetPlanetMass(hovered, mass));
+            }
+            if (IsKeyPressed(KEY_C)) {
+                simulation.Submit(SimCommand::Toggle(SimCommand::SET_COMPACT_LAYOUT, !blackHole.IsCompactLayout()));
+            }
+            if (IsKeyPressed(KEY_R)) {
+                simulation.Submit(SimCommand::Toggle(SimCommand::SET_ON_RAILS, !blackHole.IsOnRails()));
+            }
+            if (IsKeyPressed(KEY_K)) {
+                simulation.Submit(SimCommand::Toggle(SimCommand::SET_KEPLER_PROPAGATION, !blackHole.IsKeplerPropagation()));
+            }
+        }
+        if (IsKeyPressed(KEY_L)) {
+            lensEnabled = !lensEnabled;
+        }
+        if (IsKeyPressed(KEY_PERIOD)) {
+            input.warpChange++;
+        }
+        if (IsKeyPressed(KEY_COMMA)) {
+            input.warpChange--;
+        }
+        if (IsKeyPressed(KEY_SPACE)) {
+            input.toggleScrub = true;
         }
+        if (frame.scrubbing) {
+            int64_t stride = IsKeyDown(KEY_LEFT_SHIFT) ? static_cast<int64_t>(1.0f / TimeWarp::FIXED_DT + 0.5f) : 1;
+            if (IsKeyPressed(KEY_LEFT) || IsKeyPressedRepeat(KEY_LEFT)) {
+                input.seekSteps -= stride;
+            }
+            if (IsKeyPressed(KEY_RIGHT) || IsKeyPressedRepeat(KEY_RIGHT)) {
+                input.seekSteps += stride;
+            }
+            Vector2 mouse = GetMousePosition();
+            if (IsMouseButtonDown(MOUSE_LEFT_BUTTON) && mouse.y >= timelineBar.y - 10 &&
+                mouse.x >= timelineBar.x && mouse.x <= timelineBar.x + timelineBar.width) {
+                input.seekFraction = (mouse.x - timelineBar.x) / timelineBar.width;
+            }
+        }
+
+        // the next frame is simulated while this one is drawn
+        simulation.Post(std::move(input));
 
-        blackHole.Update();
+        auto drawStart = std::chrono::steady_clock::now();
+        if (lensEnabled) {
+            blackHole.UpdateLens(lens, SCREEN_WIDTH, SCREEN_HEIGHT, 1.0f);
+            BeginTextureMode(sceneTarget);
+            ClearBackground(BLACK);
+            blackHole.Draw(&particleBatch);
+            EndTextureMode();
+        }
 
         BeginDrawing();
         ClearBackground(BLACK);
-        blackHole.Draw();
-        DrawText("Right Click: Spawn Planet", 10, 10, 20, WHITE);
+        if (lensEnabled) {
+            lens.Draw(sceneTarget.texture);
+        }
+        else {
+            blackHole.Draw(&particleBatch);
+        }
+        DrawText("Right Click: Spawn Planet, Middle Click: Remove, Wheel: Mass, Left Click: Track, M + Click: Move Hole", 10, 10, 20, WHITE);
+        DrawText(TextFormat("Batch flushes: %d", particleBatch.FlushesLastFrame()), 10, 35, 20, GRAY);
+        DrawText(TextFormat("Time warp: %dx (%.1f sim s / s)", frame.warpFactor, frame.achievedRate),
+            10, 60, 20, GRAY);
+        DrawText(TextFormat("Simulate %.1f ms, draw %.1f ms", frame.simulateMilliseconds, drawMilliseconds),
+            10, 85, 20, GRAY);
+
+        const PlanetCollisionStats& collisions = blackHole.CollisionStats();
+        DrawText(TextFormat("Planets %d: %d broadphase pairs, %d overlaps, particles %d absorbed / %d scattered",
+            collisions.planets, collisions.candidatePairs, collisions.overlaps,
+            collisions.particlesAbsorbed, collisions.particlesScattered), 10, 135, 20, GRAY);
+
+        if (const Planet* planet = blackHole.GetPlanet(tracked)) {
+            DrawCircleLines(static_cast<int>(planet->position.x), static_cast<int>(planet->position.y),
+                planet->size + 6.0f, YELLOW);
+            float speed = sqrtf(planet->velocity.x * planet->velocity.x + planet->velocity.y * planet->velocity.y);
+            DrawText(TextFormat("Planet %u.%u: mass %.1f, speed %.1f", tracked.index, tracked.generation,
+                planet->mass, speed), 10, 110, 20, YELLOW);
+        }
+
+        int64_t span = std::max<int64_t>(frame.head - frame.earliest, 1);
+        float cursor = timelineBar.x + timelineBar.width * static_cast<float>(frame.current - frame.earliest) / span;
+        DrawRectangleRec(timelineBar, ColorAlpha(DARKGRAY, 0.6f));
+        DrawRectangle(static_cast<int>(cursor) - 2, static_cast<int>(timelineBar.y) - 4, 4,
+            static_cast<int>(timelineBar.height) + 8, frame.scrubbing ? ORANGE : LIGHTGRAY);
+        DrawText(TextFormat("%s step %lld / %lld, %d keyframes, %.1f MB",
+            frame.scrubbing ? "Scrubbing (Space: resume, Left/Right, Shift: 1 s)" : "Space: scrub",
+            static_cast<long long>(frame.current), static_cast<long long>(frame.head),
+            frame.keyframeCount, frame.keyframeBytes / 1048576.0),
+            10, static_cast<int>(timelineBar.y) - 26, 20, GRAY);
+        std::chrono::duration<double> drawTime = std::chrono::steady_clock::now() - drawStart;
+        drawMilliseconds = drawTime.count() * 1000.0;
         EndDrawing();
     }
 
+    lens.UnloadGpu();
+    particleBatch.Unload();
+    UnloadRenderTexture(sceneTarget);
     CloseWindow();
     return 0;
 }
\ No newline at end of file
@@ -3,8 +3,18 @@
 #define FIRE_PARTICLE_SYSTEM_H
 
 #include "raylib.h"
+#include "Emitter.h"
+#include "Random.h"
+#include "FluidGrid.h"
+#include "HeatGrid.h"
+#include "NeighbourGrid.h"
+#include "ParticlePool.h"
+#include "SlotMap.h"
+#include <cstddef>
 #include <vector>
 
+class ThreadPool;
+
 struct FireParticle {
     Vector2 position;
     Vector2 oldPosition;
@@ -15,24 +25,178 @@ struct FireParticle {
     Color color;
 };
 
+// A spawn area sharing the particle pool of a FireParticleSystem
+struct FireEmitter {
+    Vector2 origin;
+    EmitterDesc desc;
+    int budget;              // at most this many live particles
+    int alive;
+    float spawnAccumulator;
+    int pending;             // burst particles not spawned yet
+    bool visible;            // false while culled by the viewport
+};
+
+typedef SlotHandle FireEmitterHandle;
+
+// Columns of the fire's particle pool
+struct FireLayout {
+    enum Column {
+        X, Y,
+        OLD_X, OLD_Y,
+        ACCELERATION_X, ACCELERATION_Y,  // external, buoyancy is added per substep
+        LIFETIME,
+        MAX_LIFETIME,
+        TEMPERATURE,
+        COLUMNS
+    };
+};
+
+typedef ParticlePool<FireLayout, VerletIntegrator, BuoyancyForce> FireParticlePool;
+
+// Particles are stored as SoA columns (a FireParticlePool) so the Verlet step
+// runs 4 lanes at a time. FireParticle is only the per-particle view returned
+// by getParticle().
+//
+// Any number of emitters feed the same pool, so thousands of small fires
+// share one integration pass, one neighbour grid and one draw loop instead of
+// each running its own.
 class FireParticleSystem {
 private:
-    std::vector<FireParticle> particles;
-    Vector2 origin;
-    const int MAX_PARTICLES = 145;
+    FireParticlePool particles;
+    std::vector<FireEmitterHandle> emitterOf;  // particles outlive a removed emitter
+    SlotMap<FireEmitter> emitters;
+    FireEmitterHandle primary;  // the emitter created by the constructor
+    Rectangle viewport;
+    bool cullToViewport;
+    Random rng;
+    SpawnBatch spawnBatch;
+    int spawnBudget;
+    size_t spawnCursor;  // emitter that spawns first, rotates every frame
+    bool fuseSubsteps;
+    int constraintIterations;
+    int heatMode;
     const int SUBSTEPS = 8;
     const float INTERACTION_RADIUS = 15.0f;  // Radius for particle interaction
     const float HEAT_TRANSFER_RATE = 0.3f;   // Rate of heat transfer between particles
+    const float PARTICLE_SPACING = 5.0f;     // closer particles are pushed apart
+
+    // Up to MAX_NEIGHBOURS particles within a radius, rebuilt by
+    // buildNeighbours() for each solver that needs them. Indices are
+    // positions in grid order: the neighbours of sorted particle k are
+    // neighbours[k * MAX_NEIGHBOURS, k * MAX_NEIGHBOURS + neighbourCount[k])
+    static const int MAX_NEIGHBOURS = 16;
+    NeighbourGrid neighbourGrid;
+    std::vector<int> neighbourCount;
+    std::vector<int> neighbours;
+    std::vector<float> sortedX, sortedY;
+    std::vector<float> solvedX, solvedY;
+    std::vector<float> sortedTemperature, exchangedTemperature;
+    HeatGrid heatGrid;
+    FluidGrid fluidGrid;
+    bool fluidEnabled;
+    ThreadPool* pool;
+
+    // Particles per temporal block: 9 columns * 1024 floats stay in L1/L2
+    // while a block runs through all substeps. Multiple of the SIMD width.
+    static const int BLOCK_SIZE = 1024;
+
+    void integrate(size_t begin, size_t end, float dt, int substeps);
+    int spawnParticles(FireEmitter& emitter, FireEmitterHandle handle, int count);
+    void removeParticle(size_t i);
+    void buildNeighbours(float radius);
+    ThreadPool& threads() const;
 
 public:
-    FireParticleSystem(Vector2 position);
+    static const int DEFAULT_MAX_PARTICLES = 145;
+    // Kelvin. Particles cool towards it and fade out as they reach it
+    static constexpr float AMBIENT_TEMPERATURE = 300.0f;
+
+    enum HeatTransferMode {
+        HEAT_AUTO,      // pairwise up to HEAT_GRID_THRESHOLD particles, grid above
+        HEAT_PAIRWISE,  // neighbours within INTERACTION_RADIUS
+        HEAT_GRID,      // diffusion on a coarse grid, O(particles + cells)
+        HEAT_NONE
+    };
+    static const int HEAT_GRID_THRESHOLD = 4096;
+
+    // Flames rise about this far above their emitter before they die out,
+    // used to decide whether an emitter is on screen
+    static const int FLAME_REACH = 250;
+
+    // Without emitters, add them with addEmitter()
+    explicit FireParticleSystem(uint64_t seed = 7);
+    // With one emitter at position
+    FireParticleSystem(Vector2 position, int maxParticles = DEFAULT_MAX_PARTICLES, uint64_t seed = 7);
     void update(float deltaTime);
-    void draw();
+    void draw() const;
+    // Spawns one particle from the first emitter
     void addParticle();
+    // One substep over every particle; update() fuses all substeps instead
     void verletIntegration(float dt);
+    // Pushes particles closer than PARTICLE_SPACING apart. Jacobi with
+    // averaging: every particle gathers the corrections of its own
+    // constraints, so the result doesn't depend on the thread count.
     void solveConstraints();
-    void transferHeat();
-    Color getColorFromTemperature(float temperature);
+    // Each particle moves HEAT_TRANSFER_RATE (per 1/60 s) of the way towards
+    // the temperature around it
+    void transferHeat(float dt);
+    Color getColorFromTemperature(float temperature) const;
+
+    // When enabled (default) update() runs every substep of a block before
+    // moving to the next block, so each particle is loaded once per frame.
+    // Results are bit-identical to the per-substep path.
+    void setSubstepFusion(bool enabled) { fuseSubsteps = enabled; }
+    bool substepFusion() const { return fuseSubsteps; }
+
+    void setHeatTransferMode(HeatTransferMode mode) { heatMode = mode; }
+
+    // 0 turns the constraint solve off
+    void setConstraintIterations(int iterations) { constraintIterations = iterations; }
+
+    // Couples the fire to a FluidGrid over domain with cells of cellSize
+    // pixels: particles heat the air and are carried by its flow, so the
+    // plume moves as a whole. cellSize <= 0 turns it off (default).
+    void setFluidDomain(Rectangle domain, float cellSize);
+    bool fluidCoupling() const { return fluidEnabled; }
+    FluidGrid& fluid() { return fluidGrid; }
+    const FluidGrid& fluid() const { return fluidGrid; }
+
+    // nullptr uses ThreadPool::Shared()
+    void setThreadPool(ThreadPool* threadPool) { pool = threadPool; }
+
+    // The default flame: spawns in a box of halfSize, at budget / lifetime
+    // particles per second so it stays about full
+    static EmitterDesc flameEmitter(int budget, Vector2 halfSize = { 8.0f, 3.0f });
+
+    // Each emitter spawns as its desc says, up to budget live particles.
+    // Particles of a removed emitter burn out on their own.
+    FireEmitterHandle addEmitter(Vector2 position, const EmitterDesc& desc, int budget);
+    FireEmitterHandle addEmitter(Vector2 position, int budget = DEFAULT_MAX_PARTICLES,
+        Vector2 halfSize = { 8.0f, 3.0f });
+    // Queues count particles (desc.burst when negative) on top of the rate
+    void burst(FireEmitterHandle handle, int count = -1);
+    bool removeEmitter(FireEmitterHandle handle) { return emitters.Remove(handle); }
+    FireEmitter* getEmitter(FireEmitterHandle handle) { return emitters.Get(handle); }
+    const FireEmitter* getEmitter(FireEmitterHandle handle) const { return emitters.Get(handle); }
+    size_t emitterCount() const { return emitters.Size(); }
+
+    // Emitters whose flames can't reach the view stop spawning, and
+    // particles outside it aren't drawn. Off by default.
+    void setViewport(Rectangle view) { viewport = view; cullToViewport = true; }
+    void clearViewport() { cullToViewport = false; }
+
+    // At most this many particles are spawned per update, over all emitters
+    // (0 = no limit). The rest waits for the next frames, so large bursts are
+    // spread out instead of making one frame slow. Emitters take turns at
+    // spawning first.
+    void setSpawnBudget(int particlesPerFrame) { spawnBudget = particlesPerFrame; }
+
+    // The first emitter
+    void setOrigin(Vector2 position);
+    void setEmitterExtent(Vector2 halfSize);
+    Vector2 getOrigin() const;
+    size_t particleCount() const { return particles.Size(); }
+    FireParticle getParticle(size_t i) const;
 };
 
 #endif
@@ -0,0 +1,399 @@
+#include "FireParticleSystem.h"
+#include "ColorPalette.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace {
+    const float COOLING_RATE = 1.2f;   // 1/s, towards ambient
+    const float BUOYANCY = 0.15f;      // px/s^2 per kelvin above ambient
+    const float DRAG = 1.5f;           // 1/s, velocity damping
+    const float MEAN_LIFETIME = 1.5f;
+    const float NOMINAL_DT = 1.0f / 60.0f;  // used to seed the Verlet history of new particles
+    const float MAX_DRAW_RADIUS = 6.0f;
+    const float FLUID_HEATING_RATE = 0.5f;  // per 1/60 s, towards the particles in a cell
+    const float FLUID_DRAG = 6.0f;          // 1/s, particle velocity towards the flow
+}
+
+FireParticleSystem::FireParticleSystem(uint64_t seed) :
+    primary(FireEmitterHandle::Null()),
+    viewport({ 0, 0, 0, 0 }),
+    cullToViewport(false),
+    rng(seed),
+    spawnBudget(0),
+    spawnCursor(0),
+    fuseSubsteps(true),
+    constraintIterations(4),
+    heatMode(HEAT_AUTO),
+    fluidEnabled(false),
+    pool(nullptr) {
+}
+
+FireParticleSystem::FireParticleSystem(Vector2 position, int maxParticles, uint64_t seed) :
+    FireParticleSystem(seed) {
+    primary = addEmitter(position, maxParticles);
+}
+
+ThreadPool& FireParticleSystem::threads() const {
+    return pool ? *pool : ThreadPool::Shared();
+}
+
+EmitterDesc FireParticleSystem::flameEmitter(int budget, Vector2 halfSize) {
+    EmitterDesc desc;
+    desc.rate = budget / MEAN_LIFETIME;
+    desc.shape = EmitterDesc::SHAPE_BOX;
+    desc.extent = halfSize;
+    desc.velocity = EmitterDesc::VELOCITY_BOX;
+    desc.velocityMin = { -20.0f, -60.0f };
+    desc.velocityMax = { 20.0f, -20.0f };
+    desc.lifetimeMin = MEAN_LIFETIME - 0.5f;
+    desc.lifetimeMax = MEAN_LIFETIME + 0.5f;
+    return desc;
+}
+
+FireEmitterHandle FireParticleSystem::addEmitter(Vector2 position, const EmitterDesc& desc, int budget) {
+    return emitters.Insert({ position, desc, budget, 0, 0.0f, 0, true });
+}
+
+FireEmitterHandle FireParticleSystem::addEmitter(Vector2 position, int budget, Vector2 halfSize) {
+    return addEmitter(position, flameEmitter(budget, halfSize), budget);
+}
+
+void FireParticleSystem::burst(FireEmitterHandle handle, int count) {
+    if (FireEmitter* emitter = emitters.Get(handle)) emitter->pending += count < 0 ? emitter->desc.burst : count;
+}
+
+void FireParticleSystem::setFluidDomain(Rectangle domain, float cellSize) {
+    fluidEnabled = cellSize > 0.0f;
+    if (!fluidEnabled) return;
+    fluidGrid.Resize(domain.x, domain.y, static_cast<int>(ceilf(domain.width / cellSize)),
+        static_cast<int>(ceilf(domain.height / cellSize)), cellSize, AMBIENT_TEMPERATURE);
+    fluidGrid.SetBuoyancy(BUOYANCY, COOLING_RATE);
+}
+
+void FireParticleSystem::setOrigin(Vector2 position) {
+    if (FireEmitter* emitter = emitters.Get(primary)) emitter->origin = position;
+}
+
+void FireParticleSystem::setEmitterExtent(Vector2 halfSize) {
+    if (FireEmitter* emitter = emitters.Get(primary)) emitter->desc.extent = halfSize;
+}
+
+Vector2 FireParticleSystem::getOrigin() const {
+    const FireEmitter* emitter = emitters.Get(primary);
+    return emitter ? emitter->origin : Vector2{ 0, 0 };
+}
+
+void FireParticleSystem::addParticle() {
+    if (FireEmitter* emitter = emitters.Get(primary)) spawnParticles(*emitter, primary, 1);
+}
+
+// Positions, velocities and lifetimes come from the emitter's desc; the
+// fire's own columns are drawn in batches too
+int FireParticleSystem::spawnParticles(FireEmitter& emitter, FireEmitterHandle handle, int count) {
+    count = std::min(count, emitter.budget - emitter.alive);
+    if (count <= 0) return 0;
+    emitter.alive += count;
+
+    spawnBatch.Clear();
+    GenerateSpawns(emitter.desc, emitter.origin, count, rng, spawnBatch);
+
+    const size_t at = particleCount();
+    const size_t size = at + count;
+    particles.Resize(size);
+    emitterOf.resize(size, handle);
+    float* x = &particles[FireLayout::X][at];
+    float* y = &particles[FireLayout::Y][at];
+    float* oldX = &particles[FireLayout::OLD_X][at];
+    float* oldY = &particles[FireLayout::OLD_Y][at];
+    float* lifetime = &particles[FireLayout::LIFETIME][at];
+    float* maxLifetime = &particles[FireLayout::MAX_LIFETIME][at];
+    float* accelerationY = &particles[FireLayout::ACCELERATION_Y][at];
+
+    const float h = NOMINAL_DT / SUBSTEPS;
+    for (int i = 0; i < count; i++) {
+        x[i] = spawnBatch.x[i];
+        y[i] = spawnBatch.y[i];
+        oldX[i] = spawnBatch.x[i] - spawnBatch.velocityX[i] * h;
+        oldY[i] = spawnBatch.y[i] - spawnBatch.velocityY[i] * h;
+        lifetime[i] = spawnBatch.lifetime[i];
+        maxLifetime[i] = spawnBatch.lifetime[i];
+        accelerationY[i] = 0.0f;
+    }
+    FillUniform(rng, -30.0f, 30.0f, count, &particles[FireLayout::ACCELERATION_X][at]);
+    FillUniform(rng, 1200.0f, 1800.0f, count, &particles[FireLayout::TEMPERATURE][at]);
+    return count;
+}
+
+void FireParticleSystem::removeParticle(size_t i) {
+    particles.Remove(i);
+    if (FireEmitter* emitter = emitters.Get(emitterOf[i])) emitter->alive--;
+    emitterOf[i] = emitterOf.back();
+    emitterOf.pop_back();
+}
+
+// Runs substeps of Verlet over [begin, end). Per substep the particle cools
+// towards ambient, buoyancy follows the new temperature, and
+// x' = x + (x - x_old) * damping + a * dt^2.
+void FireParticleSystem::integrate(size_t begin, size_t end, float dt, int substeps) {
+    const FireParticlePool::ForceType force(dt, AMBIENT_TEMPERATURE, expf(-COOLING_RATE * dt), BUOYANCY);
+    const FireParticlePool::IntegratorType integrator(dt, expf(-DRAG * dt));
+    particles.Step(begin, end, substeps, force, integrator);
+}
+
+void FireParticleSystem::verletIntegration(float dt) {
+    threads().ParallelFor(static_cast<int>(particleCount()), BLOCK_SIZE, [&](int begin, int end) {
+        integrate(begin, end, dt, 1);
+    });
+}
+
+void FireParticleSystem::update(float deltaTime) {
+    int frameBudget = spawnBudget > 0 ? spawnBudget : INT_MAX;
+    const size_t emitterTotal = emitters.Size();
+    for (size_t k = 0; k < emitterTotal; k++) {
+        const size_t e = (spawnCursor + k) % emitterTotal;
+        FireEmitter& emitter = emitters[e];
+        if (cullToViewport) {
+            // flames rise, so the reach mostly extends upwards; sideways they
+            // only drift a little
+            const float drift = FLAME_REACH * 0.25f;
+            const Vector2 extent = emitter.desc.extent;
+            emitter.visible =
+                emitter.origin.x + extent.x + drift >= viewport.x &&
+                emitter.origin.x - extent.x - drift <= viewport.x + viewport.width &&
+                emitter.origin.y + extent.y >= viewport.y &&
+                emitter.origin.y - extent.y - FLAME_REACH <= viewport.y + viewport.height;
+        }
+        else {
+            emitter.visible = true;
+        }
+        if (!emitter.visible) {
+            emitter.spawnAccumulator = 0;
+            emitter.pending = 0;
+            continue;
+        }
+
+        // what doesn't fit the emitter's budget is dropped, what doesn't fit
+        // the frame's waits
+        emitter.spawnAccumulator += deltaTime * emitter.desc.rate;
+        const int due = static_cast<int>(emitter.spawnAccumulator);
+        emitter.spawnAccumulator -= due;
+        const int wanted = std::min(due + emitter.pending, std::max(emitter.budget - emitter.alive, 0));
+        const int spawned = spawnParticles(emitter, emitters.HandleAt(e), std::min(wanted, frameBudget));
+        emitter.pending = wanted - spawned;
+        frameBudget -= spawned;
+    }
+    spawnCursor = emitterTotal ? (spawnCursor + 1) % emitterTotal : 0;
+
+    // Temporal blocking: particles don't interact during the substeps, so a
+    // block can run all of them while it is in cache instead of streaming the
+    // whole pool once per substep
+    float dt = deltaTime / SUBSTEPS;
+    if (fuseSubsteps) {
+        threads().ParallelFor(static_cast<int>(particleCount()), BLOCK_SIZE, [&](int begin, int end) {
+            for (int block = begin; block < end; block += BLOCK_SIZE) {
+                integrate(block, std::min(block + BLOCK_SIZE, end), dt, SUBSTEPS);
+            }
+        });
+    }
+    else {
+        for (int s = 0; s < SUBSTEPS; s++) {
+            verletIntegration(dt);
+        }
+    }
+
+    if (fluidEnabled) {
+        const int count = static_cast<int>(particleCount());
+        float* x = particles[FireLayout::X].data();
+        float* y = particles[FireLayout::Y].data();
+        fluidGrid.AddTemperature(x, y, particles[FireLayout::TEMPERATURE].data(), count,
+            1.0f - powf(1.0f - FLUID_HEATING_RATE, deltaTime * 60.0f));
+        fluidGrid.Step(deltaTime, threads());
+        fluidGrid.Carry(x, y, particles[FireLayout::OLD_X].data(), particles[FireLayout::OLD_Y].data(), count,
+            dt, 1.0f - expf(-FLUID_DRAG * deltaTime), threads());
+    }
+
+    solveConstraints();
+    transferHeat(deltaTime);
+
+    for (size_t i = particleCount(); i-- > 0;) {
+        if (particles[FireLayout::LIFETIME][i] <= 0.0f) removeParticle(i);
+    }
+}
+
+// Fixed-size neighbour lists, so a single parallel pass fills them and a
+// dense cluster (every particle of a fresh fire starts in the emitter) can't
+// make them quadratic. Lists are in grid order whatever the thread count.
+void FireParticleSystem::buildNeighbours(float radius) {
+    const int count = static_cast<int>(particleCount());
+    neighbourGrid.Build(particles[FireLayout::X].data(), particles[FireLayout::Y].data(), count, radius);
+
+    neighbourCount.resize(count);
+    neighbours.resize(static_cast<size_t>(count) * MAX_NEIGHBOURS);
+    threads().ParallelFor(count, BLOCK_SIZE, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            int* list = neighbours.data() + static_cast<size_t>(k) * MAX_NEIGHBOURS;
+            int found = 0;
+            neighbourGrid.VisitNeighbours(k, [&](int j) {
+                list[found++] = j;
+                return found < MAX_NEIGHBOURS;
+            });
+            neighbourCount[k] = found;
+        }
+    });
+}
+
+// Gauss-Seidel would update particles in place, which serializes the sweep.
+// Each Jacobi iteration instead reads the previous positions and writes new
+// ones: x_i += OVER_RELAXATION / n_i * sum of the n_i pair corrections, where
+// each violated pair moves i by half the overlap. The iterations run on the
+// grid-sorted copy, so neighbours are close in memory too. Pairs are found
+// with some margin, as the iterations move particles a little.
+void FireParticleSystem::solveConstraints() {
+    const float OVER_RELAXATION = 1.5f;
+    const int count = static_cast<int>(particleCount());
+    if (count == 0 || constraintIterations <= 0) return;
+
+    buildNeighbours(PARTICLE_SPACING * 1.5f);
+    sortedX.assign(neighbourGrid.SortedX(), neighbourGrid.SortedX() + count);
+    sortedY.assign(neighbourGrid.SortedY(), neighbourGrid.SortedY() + count);
+    solvedX.resize(count);
+    solvedY.resize(count);
+
+    for (int iteration = 0; iteration < constraintIterations; iteration++) {
+        const float* px = sortedX.data();
+        const float* py = sortedY.data();
+        threads().ParallelFor(count, BLOCK_SIZE, [&](int begin, int end) {
+            for (int k = begin; k < end; k++) {
+                const int* list = neighbours.data() + static_cast<size_t>(k) * MAX_NEIGHBOURS;
+                float correctionX = 0.0f, correctionY = 0.0f;
+                int violated = 0;
+                for (int n = 0; n < neighbourCount[k]; n++) {
+                    int j = list[n];
+                    float dx = px[k] - px[j];
+                    float dy = py[k] - py[j];
+                    float distSq = dx * dx + dy * dy;
+                    if (distSq >= PARTICLE_SPACING * PARTICLE_SPACING || distSq < 1e-12f) continue;
+                    float dist = sqrtf(distSq);
+                    float push = 0.5f * (PARTICLE_SPACING - dist) / dist;
+                    correctionX += dx * push;
+                    correctionY += dy * push;
+                    violated++;
+                }
+                float scale = violated ? OVER_RELAXATION / violated : 0.0f;
+                solvedX[k] = px[k] + correctionX * scale;
+                solvedY[k] = py[k] + correctionY * scale;
+            }
+        });
+        sortedX.swap(solvedX);
+        sortedY.swap(solvedY);
+    }
+
+    neighbourGrid.Scatter(sortedX.data(), particles[FireLayout::X].data());
+    neighbourGrid.Scatter(sortedY.data(), particles[FireLayout::Y].data());
+}
+
+// Pairwise: the mean temperature of the neighbours, weighted by 1 - d / R.
+// Grid: the same exchange as diffusion between the nodes of a coarse field,
+// so the cost doesn't grow with how many particles crowd together. Both read
+// the old temperatures only, so neither depends on the thread count.
+void FireParticleSystem::transferHeat(float dt) {
+    const int count = static_cast<int>(particleCount());
+    if (count == 0 || heatMode == HEAT_NONE) return;
+    const float amount = 1.0f - powf(1.0f - HEAT_TRANSFER_RATE, dt * 60.0f);
+
+    bool useGrid = heatMode == HEAT_GRID || (heatMode == HEAT_AUTO && count > HEAT_GRID_THRESHOLD);
+    if (useGrid) {
+        const float* x = particles[FireLayout::X].data();
+        const float* y = particles[FireLayout::Y].data();
+        float* t = particles[FireLayout::TEMPERATURE].data();
+        heatGrid.Splat(x, y, t, count, INTERACTION_RADIUS);
+        heatGrid.Diffuse(amount, 1, threads());
+        heatGrid.Gather(x, y, t, count, amount, threads());
+        return;
+    }
+
+    buildNeighbours(INTERACTION_RADIUS);
+    const float* x = neighbourGrid.SortedX();
+    const float* y = neighbourGrid.SortedY();
+    sortedTemperature.resize(count);
+    exchangedTemperature.resize(count);
+    neighbourGrid.Gather(particles[FireLayout::TEMPERATURE].data(), sortedTemperature.data());
+    const float* t = sortedTemperature.data();
+
+    threads().ParallelFor(count, BLOCK_SIZE, [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            const int* list = neighbours.data() + static_cast<size_t>(k) * MAX_NEIGHBOURS;
+            float weighted = 0.0f, total = 0.0f;
+            for (int n = 0; n < neighbourCount[k]; n++) {
+                int j = list[n];
+                float dx = x[k] - x[j];
+                float dy = y[k] - y[j];
+                float w = 1.0f - sqrtf(dx * dx + dy * dy) / INTERACTION_RADIUS;
+                weighted += w * t[j];
+                total += w;
+            }
+            exchangedTemperature[k] = total > 0.0f ? t[k] + amount * (weighted / total - t[k]) : t[k];
+        }
+    });
+    neighbourGrid.Scatter(exchangedTemperature.data(), particles[FireLayout::TEMPERATURE].data());
+}
+
+Color FireParticleSystem::getColorFromTemperature(float temperature) const {
+    return ColorPalette::Blackbody().Lookup(temperature);
+}
+
+FireParticle FireParticleSystem::getParticle(size_t i) const {
+    FireParticle p;
+    p.position = { particles[FireLayout::X][i], particles[FireLayout::Y][i] };
+    p.oldPosition = { particles[FireLayout::OLD_X][i], particles[FireLayout::OLD_Y][i] };
+    p.acceleration = { particles[FireLayout::ACCELERATION_X][i], particles[FireLayout::ACCELERATION_Y][i] };
+    p.lifetime = particles[FireLayout::LIFETIME][i];
+    p.maxLifetime = particles[FireLayout::MAX_LIFETIME][i];
+    p.temperature = particles[FireLayout::TEMPERATURE][i];
+    p.color = getColorFromTemperature(p.temperature);
+    return p;
+}
+
+void FireParticleSystem::draw() const {
+    const int count = static_cast<int>(particleCount());
+    const std::vector<float>& x = particles[FireLayout::X];
+    const std::vector<float>& y = particles[FireLayout::Y];
+    const std::vector<float>& lifetime = particles[FireLayout::LIFETIME];
+    const std::vector<float>& maxLifetime = particles[FireLayout::MAX_LIFETIME];
+    const std::vector<float>& temperature = particles[FireLayout::TEMPERATURE];
+    // circles are at most MAX_DRAW_RADIUS wide, so anything further outside
+    // the viewport can't touch it
+    const float left = viewport.x - MAX_DRAW_RADIUS;
+    const float top = viewport.y - MAX_DRAW_RADIUS;
+    const float right = viewport.x + viewport.width + MAX_DRAW_RADIUS;
+    const float bottom = viewport.y + viewport.height + MAX_DRAW_RADIUS;
+    // visible particles are gathered in chunks on the stack and only those
+    // are colored, 4 at a time
+    const int CHUNK = 256;
+    int visible[CHUNK];
+    float visibleTemperature[CHUNK];
+    Color colors[CHUNK];
+    int gathered = 0;
+    auto flush = [&]() {
+        ColorPalette::Blackbody().LookupBatch(visibleTemperature, gathered, colors);
+        for (int k = 0; k < gathered; k++) {
+            int i = visible[k];
+            float size = 2.0f + 4.0f * lifetime[i] / maxLifetime[i];
+            DrawCircleV({ x[i], y[i] }, size, colors[k]);
+        }
+        gathered = 0;
+    };
+    for (int i = 0; i < count; i++) {
+        if (cullToViewport &&
+            (x[i] < left || x[i] > right || y[i] < top || y[i] > bottom)) {
+            continue;
+        }
+        visible[gathered] = i;
+        visibleTemperature[gathered] = temperature[i];
+        if (++gathered == CHUNK) flush();
+    }
+    flush();
+}
@@ -0,0 +1,282 @@
+#include "FluidGrid.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const int ROW_GRAIN = 16;
+    const int CARRY_GRAIN = 4096;
+}
+
+// The grid is staggered (MAC): velocityX at Cell(i, j) is the flow through
+// the left face of cell (i, j), velocityY the flow through its top face, so
+// divergence and pressure gradient are plain differences of neighbours and
+// the projection has no checkerboard modes. Faces i = columns and j = rows
+// fall into the border.
+FluidGrid::FluidGrid() :
+    originX(0),
+    originY(0),
+    cellSize(1),
+    ambient(300),
+    buoyancy(0.15f),
+    coolingRate(0.8f),
+    residual(0),
+    pressureIterations(40),
+    columns(0),
+    rows(0),
+    stride(4) {
+}
+
+void FluidGrid::Resize(float x, float y, int columnCount, int rowCount, float size, float ambientTemperature) {
+    originX = x;
+    originY = y;
+    columns = std::max(columnCount, 2);
+    rows = std::max(rowCount, 2);
+    cellSize = std::max(size, 1e-3f);
+    ambient = ambientTemperature;
+    residual = 0;
+    stride = (columns + 2 + 3) & ~3;
+
+    const size_t cells = static_cast<size_t>(stride) * (rows + 2);
+    velocityX.assign(cells, 0.0f);
+    velocityY.assign(cells, 0.0f);
+    temperature.assign(cells, ambient);
+    nextX.assign(cells, 0.0f);
+    nextY.assign(cells, 0.0f);
+    nextTemperature.assign(cells, ambient);
+    pressure.assign(cells, 0.0f);
+    nextPressure.assign(cells, 0.0f);
+    divergence.assign(cells, 0.0f);
+    weight.assign(cells, 0.0f);
+    splat.assign(cells, 0.0f);
+}
+
+// Bilinear over stored values, fx and fy in units of cells from the first
+// stored sample and clamped to the samples that exist (lastX, lastY)
+float FluidGrid::Sample(const std::vector<float>& field, float fx, float fy, int lastX, int lastY) const {
+    fx = std::min(std::max(fx, 0.0f), static_cast<float>(lastX));
+    fy = std::min(std::max(fy, 0.0f), static_cast<float>(lastY));
+    int cx = std::min(static_cast<int>(fx), lastX - 1);
+    int cy = std::min(static_cast<int>(fy), lastY - 1);
+    float tx = fx - cx;
+    float ty = fy - cy;
+    int n = Cell(cx, cy);
+    return (1 - ty) * ((1 - tx) * field[n] + tx * field[n + 1]) +
+        ty * ((1 - tx) * field[n + stride] + tx * field[n + stride + 1]);
+}
+
+void FluidGrid::CopyBorder(std::vector<float>& field) {
+    for (int x = 0; x < columns; x++) {
+        field[Cell(x, -1)] = field[Cell(x, 0)];
+        field[Cell(x, rows)] = field[Cell(x, rows - 1)];
+    }
+    for (int y = -1; y <= rows; y++) {
+        field[Cell(-1, y)] = field[Cell(0, y)];
+        field[Cell(columns, y)] = field[Cell(columns - 1, y)];
+    }
+}
+
+void FluidGrid::AddTemperature(const float* x, const float* y, const float* t, int count, float amount) {
+    if (columns == 0) return;
+    std::fill(weight.begin(), weight.end(), 0.0f);
+    std::fill(splat.begin(), splat.end(), 0.0f);
+
+    const float inverseCellSize = 1.0f / cellSize;
+    for (int i = 0; i < count; i++) {
+        float fx = (x[i] - originX) * inverseCellSize - 0.5f;
+        float fy = (y[i] - originY) * inverseCellSize - 0.5f;
+        if (!(fx >= 0.0f && fy >= 0.0f && fx < columns - 1 && fy < rows - 1)) continue;
+        int cx = static_cast<int>(fx);
+        int cy = static_cast<int>(fy);
+        float tx = fx - cx;
+        float ty = fy - cy;
+        int n = Cell(cx, cy);
+        float w[4] = { (1 - tx) * (1 - ty), tx * (1 - ty), (1 - tx) * ty, tx * ty };
+        int corner[4] = { n, n + 1, n + stride, n + stride + 1 };
+        for (int c = 0; c < 4; c++) {
+            weight[corner[c]] += w[c];
+            splat[corner[c]] += w[c] * t[i];
+        }
+    }
+
+    // a cell touched by a fraction of a point only moves that fraction as far
+    for (size_t n = 0; n < weight.size(); n++) {
+        if (weight[n] > 0.0f) {
+            temperature[n] += amount * std::min(weight[n], 1.0f) * (splat[n] / weight[n] - temperature[n]);
+        }
+    }
+}
+
+void FluidGrid::Step(float dt, ThreadPool& pool) {
+    if (columns == 0 || dt <= 0.0f) return;
+
+    // Hot air rises: every horizontal face is pushed up by the temperature of
+    // the two cells it separates. The air cools towards ambient meanwhile.
+    CopyBorder(temperature);
+    const Float4 lift4 = Float4::Set1(0.5f * dt * buoyancy);
+    const Float4 ambient4 = Float4::Set1(ambient);
+    const Float4 two4 = Float4::Set1(2.0f);
+    const float decay = expf(-coolingRate * dt);
+    const float* t = temperature.data();
+    float* vy = velocityY.data();
+    pool.ParallelFor(rows + 1, ROW_GRAIN, [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            int n = Cell(0, y);
+            const int rowEnd = Cell(columns, y);
+            for (; n + 4 <= rowEnd; n += 4) {
+                Float4 heat = Float4::Load(t + n) + Float4::Load(t + n - stride) - two4 * ambient4;
+                (Float4::Load(vy + n) - lift4 * heat).Store(vy + n);
+            }
+            for (; n < rowEnd; n++) {
+                vy[n] -= 0.5f * dt * buoyancy * (t[n] + t[n - stride] - 2.0f * ambient);
+            }
+        }
+    });
+    for (float& cell : temperature) {
+        cell = ambient + (cell - ambient) * decay;
+    }
+
+    Advect(dt, pool);
+    Project(pool);
+}
+
+// Semi-Lagrangian: every sample traces back along the flow and takes the
+// value found there, reading only the previous fields
+void FluidGrid::Advect(float dt, ThreadPool& pool) {
+    const float back = dt / cellSize;
+    pool.ParallelFor(rows + 1, ROW_GRAIN, [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            for (int x = 0; x <= columns; x++) {
+                const int n = Cell(x, y);
+                // sample positions in cells: u at (x, y + 0.5), v at
+                // (x + 0.5, y), temperature at (x + 0.5, y + 0.5)
+                if (y < rows) {
+                    float u = velocityX[n];
+                    float v = SampleY(x - 0.5f, y + 0.5f);
+                    nextX[n] = SampleX(x - back * u, y - back * v);
+                }
+                if (x < columns) {
+                    float u = SampleX(x + 0.5f, y - 0.5f);
+                    float v = velocityY[n];
+                    nextY[n] = SampleY(x - back * u, y - back * v);
+                }
+                if (x < columns && y < rows) {
+                    float u = 0.5f * (velocityX[n] + velocityX[n + 1]);
+                    float v = 0.5f * (velocityY[n] + velocityY[n + stride]);
+                    nextTemperature[n] = Sample(temperature, x - back * u, y - back * v, columns - 1, rows - 1);
+                }
+            }
+        }
+    });
+    velocityX.swap(nextX);
+    velocityY.swap(nextY);
+    temperature.swap(nextTemperature);
+}
+
+// Solves laplacian(p) = div(velocity) with Jacobi iterations, 4 cells at a
+// time, and subtracts grad(p). Border pressures stay 0.
+void FluidGrid::Project(ThreadPool& pool) {
+    const float inverseCellSize = 1.0f / cellSize;
+    const float* u = velocityX.data();
+    const float* v = velocityY.data();
+    float* div = divergence.data();
+    auto computeDivergence = [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            for (int n = Cell(0, y), rowEnd = Cell(columns, y); n < rowEnd; n++) {
+                div[n] = (u[n + 1] - u[n] + v[n + stride] - v[n]) * inverseCellSize;
+            }
+        }
+    };
+    pool.ParallelFor(rows, ROW_GRAIN, computeDivergence);
+
+    const Float4 scale4 = Float4::Set1(cellSize * cellSize);
+    const Float4 quarter4 = Float4::Set1(0.25f);
+    for (int iteration = 0; iteration < pressureIterations; iteration++) {
+        const float* p = pressure.data();
+        float* out = nextPressure.data();
+        pool.ParallelFor(rows, ROW_GRAIN, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                int n = Cell(0, y);
+                const int rowEnd = Cell(columns, y);
+                for (; n + 4 <= rowEnd; n += 4) {
+                    Float4 sum = Float4::Load(p + n - 1) + Float4::Load(p + n + 1) +
+                        Float4::Load(p + n - stride) + Float4::Load(p + n + stride);
+                    ((sum - scale4 * Float4::Load(div + n)) * quarter4).Store(out + n);
+                }
+                for (; n < rowEnd; n++) {
+                    float sum = p[n - 1] + p[n + 1] + p[n - stride] + p[n + stride];
+                    out[n] = (sum - cellSize * cellSize * div[n]) * 0.25f;
+                }
+            }
+        });
+        pressure.swap(nextPressure);
+    }
+
+    const float* p = pressure.data();
+    float* ux = velocityX.data();
+    float* vy = velocityY.data();
+    const Float4 inverse4 = Float4::Set1(inverseCellSize);
+    pool.ParallelFor(rows + 1, ROW_GRAIN, [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            const int rowStart = Cell(0, y);
+            // faces 0 to columns horizontally, faces 0 to rows vertically
+            const int xEnd = y < rows ? Cell(columns + 1, y) : rowStart;
+            const int yEnd = Cell(columns, y);
+            int n = rowStart;
+            for (; n + 4 <= xEnd; n += 4) {
+                Float4 gradient = (Float4::Load(p + n) - Float4::Load(p + n - 1)) * inverse4;
+                (Float4::Load(ux + n) - gradient).Store(ux + n);
+            }
+            for (; n < xEnd; n++) {
+                ux[n] -= (p[n] - p[n - 1]) * inverseCellSize;
+            }
+            n = rowStart;
+            for (; n + 4 <= yEnd; n += 4) {
+                Float4 gradient = (Float4::Load(p + n) - Float4::Load(p + n - stride)) * inverse4;
+                (Float4::Load(vy + n) - gradient).Store(vy + n);
+            }
+            for (; n < yEnd; n++) {
+                vy[n] -= (p[n] - p[n - stride]) * inverseCellSize;
+            }
+        }
+    });
+
+    // per row sums added in order, so the residual doesn't depend on the
+    // thread count
+    std::vector<float> rowSums(rows, 0.0f);
+    pool.ParallelFor(rows, ROW_GRAIN, [&](int begin, int end) {
+        computeDivergence(begin, end);
+        for (int y = begin; y < end; y++) {
+            for (int n = Cell(0, y), rowEnd = Cell(columns, y); n < rowEnd; n++) {
+                rowSums[y] += div[n] * div[n];
+            }
+        }
+    });
+    float total = 0.0f;
+    for (float sum : rowSums) {
+        total += sum;
+    }
+    residual = sqrtf(total / (static_cast<float>(columns) * rows));
+}
+
+void FluidGrid::Carry(const float* x, const float* y, float* oldX, float* oldY, int count, float h, float amount,
+    ThreadPool& pool) const {
+    if (columns == 0 || h <= 0.0f) return;
+    const float inverseCellSize = 1.0f / cellSize;
+    pool.ParallelFor(count, CARRY_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            float fx = (x[i] - originX) * inverseCellSize;
+            float fy = (y[i] - originY) * inverseCellSize;
+            if (!(fx >= 0.0f && fy >= 0.0f && fx <= columns && fy <= rows)) continue;
+            float flowX = SampleX(fx, fy - 0.5f);
+            float flowY = SampleY(fx - 0.5f, fy);
+            float vx = (x[i] - oldX[i]) / h;
+            float vy = (y[i] - oldY[i]) / h;
+            vx += amount * (flowX - vx);
+            vy += amount * (flowY - vy);
+            oldX[i] = x[i] - vx * h;
+            oldY[i] = y[i] - vy * h;
+        }
+    });
+}
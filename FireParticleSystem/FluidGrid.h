@@ -0,0 +1,76 @@
+#pragma once
+#ifndef FLUID_GRID_H
+#define FLUID_GRID_H
+
+#include <vector>
+
+class ThreadPool;
+
+// Stable fluids (Stam) on a fixed grid of cells: hot air rises, velocity and
+// temperature are advected semi-Lagrangian, and a pressure projection keeps
+// the flow divergence free. The cost depends on the cell count only, so a
+// plume keeps its shape however few particles trace it.
+//
+// The grid is staggered (MAC): temperature and pressure live at cell
+// centres, the horizontal velocity on the left face of each cell and the
+// vertical velocity on its top face. The domain is open: pressure is 0
+// outside it, so air flows in and out at the edges.
+class FluidGrid {
+public:
+    FluidGrid();
+
+    // Covers columns * rows cells of cellSize pixels from (originX, originY)
+    // and resets the flow to still air at the ambient temperature
+    void Resize(float originX, float originY, int columns, int rows, float cellSize, float ambient);
+
+    // Cells under the points move the fraction amount towards the mean
+    // temperature of the points in them (bilinear weights)
+    void AddTemperature(const float* x, const float* y, const float* temperature, int count, float amount);
+
+    // Buoyancy, advection and projection over dt seconds
+    void Step(float dt, ThreadPool& pool);
+
+    // Points moving (x - oldX) / h per second move the fraction amount
+    // towards the flow velocity at their position. Points outside the
+    // domain are left alone.
+    void Carry(const float* x, const float* y, float* oldX, float* oldY, int count, float h, float amount,
+        ThreadPool& pool) const;
+
+    // Jacobi iterations per projection. The pressure of the previous step is
+    // the starting guess, so a steady plume needs few.
+    void SetPressureIterations(int iterations) { pressureIterations = iterations; }
+    // Upward acceleration in px/s^2 per kelvin above ambient, and the rate
+    // (1/s) at which the air cools back to ambient
+    void SetBuoyancy(float perKelvin, float cooling) { buoyancy = perKelvin; coolingRate = cooling; }
+
+    int Columns() const { return columns; }
+    int Rows() const { return rows; }
+    // Root mean square divergence (1/s) left after the last projection
+    float Divergence() const { return residual; }
+
+private:
+    // Cells are stored with a border of one cell on every side, like
+    // HeatGrid. Rows are padded to the SIMD width.
+    std::vector<float> velocityX, velocityY, temperature;
+    std::vector<float> nextX, nextY, nextTemperature;
+    std::vector<float> pressure, nextPressure, divergence;
+    std::vector<float> weight, splat;  // AddTemperature scratch
+    float originX, originY;
+    float cellSize;
+    float ambient;
+    float buoyancy, coolingRate;
+    float residual;
+    int pressureIterations;
+    int columns, rows;
+    int stride;
+
+    int Cell(int x, int y) const { return (y + 1) * stride + x + 1; }
+    float Sample(const std::vector<float>& field, float fx, float fy, int lastX, int lastY) const;
+    float SampleX(float fx, float fy) const { return Sample(velocityX, fx, fy, columns, rows - 1); }
+    float SampleY(float fx, float fy) const { return Sample(velocityY, fx, fy, columns - 1, rows); }
+    void Advect(float dt, ThreadPool& pool);
+    void Project(ThreadPool& pool);
+    void CopyBorder(std::vector<float>& field);
+};
+
+#endif
@@ -0,0 +1,172 @@
+#include "GravitationalLens.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    const char* LENS_VERTEX_SHADER =
+        "#version 330\n"
+        "in vec3 vertexPosition;\n"
+        "uniform mat4 mvp;\n"
+        "void main() { gl_Position = mvp * vec4(vertexPosition, 1.0); }\n";
+
+    // lensMap holds the normalized source position (y down) and a shadow mask,
+    // the scene render texture is stored y up
+    const char* LENS_FRAGMENT_SHADER =
+        "#version 330\n"
+        "uniform sampler2D texture0;\n"
+        "uniform sampler2D lensMap;\n"
+        "uniform vec2 resolution;\n"
+        "out vec4 finalColor;\n"
+        "void main() {\n"
+        "    vec2 screenUv = vec2(gl_FragCoord.x / resolution.x, 1.0 - gl_FragCoord.y / resolution.y);\n"
+        "    vec3 source = texture(lensMap, screenUv).xyz;\n"
+        "    finalColor = vec4(texture(texture0, vec2(source.x, 1.0 - source.y)).rgb * source.z, 1.0);\n"
+        "}\n";
+}
+
+GravitationalLens::GravitationalLens(ThreadPool& pool) :
+    pool(pool),
+    center({ 0, 0 }),
+    einsteinRadius(0),
+    shadowRadius(0),
+    width(0),
+    height(0),
+    mapLocation(-1),
+    resolutionLocation(-1),
+    gpuLoaded(false),
+    mapTextureDirty(true) {
+
+    memset(&shader, 0, sizeof(shader));
+    memset(&mapTexture, 0, sizeof(mapTexture));
+}
+
+GravitationalLens::~GravitationalLens() {
+    UnloadGpu();
+}
+
+bool GravitationalLens::Update(Vector2 newCenter, float newEinsteinRadius, float newShadowRadius, int newWidth, int newHeight) {
+    if (newCenter.x == center.x && newCenter.y == center.y &&
+        newEinsteinRadius == einsteinRadius && newShadowRadius == shadowRadius &&
+        newWidth == width && newHeight == height) {
+        return false;
+    }
+
+    center = newCenter;
+    einsteinRadius = newEinsteinRadius;
+    shadowRadius = newShadowRadius;
+    width = newWidth;
+    height = newHeight;
+    Rebuild();
+    return true;
+}
+
+void GravitationalLens::Rebuild() {
+    sourceIndex.resize(static_cast<size_t>(width) * height);
+    const float einstein2 = einsteinRadius * einsteinRadius;
+
+    pool.ParallelFor(height, 8, [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            for (int x = 0; x < width; x++) {
+                float dx = x + 0.5f - center.x;
+                float dy = y + 0.5f - center.y;
+                float r2 = dx * dx + dy * dy;
+                int& index = sourceIndex[static_cast<size_t>(y) * width + x];
+
+                if (r2 < shadowRadius * shadowRadius || r2 <= 0.0f) {
+                    index = -1;
+                    continue;
+                }
+
+                // deflection towards the hole shrinks with 1/r, inside the
+                // Einstein ring the image of the far side shows up mirrored
+                float shrink = 1.0f - einstein2 / r2;
+                int sx = static_cast<int>(floorf(center.x + dx * shrink));
+                int sy = static_cast<int>(floorf(center.y + dy * shrink));
+                sx = std::min(std::max(sx, 0), width - 1);
+                sy = std::min(std::max(sy, 0), height - 1);
+                index = sy * width + sx;
+            }
+        }
+    });
+
+    mapTextureDirty = true;
+}
+
+void GravitationalLens::Apply(SoftwareRenderer& renderer) {
+    if (renderer.Width() != width || renderer.Height() != height || sourceIndex.empty()) return;
+
+    float* pixels = renderer.MutablePixels();
+    scratch.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+
+    pool.ParallelFor(height, 8, [&](int begin, int end) {
+        for (size_t i = static_cast<size_t>(begin) * width; i < static_cast<size_t>(end) * width; i++) {
+            float* dst = pixels + i * 4;
+            int source = sourceIndex[i];
+            if (source < 0) {
+                dst[0] = dst[1] = dst[2] = 0.0f;
+                continue;
+            }
+            const float* src = &scratch[static_cast<size_t>(source) * 4];
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst[3] = src[3];
+        }
+    });
+}
+
+void GravitationalLens::Draw(Texture2D scene) {
+    Rectangle flipped = { 0, 0, static_cast<float>(scene.width), -static_cast<float>(scene.height) };
+
+    if (!gpuLoaded) {
+        shader = LoadShaderFromMemory(LENS_VERTEX_SHADER, LENS_FRAGMENT_SHADER);
+        mapLocation = GetShaderLocation(shader, "lensMap");
+        resolutionLocation = GetShaderLocation(shader, "resolution");
+        gpuLoaded = true;
+        mapTextureDirty = true;
+    }
+
+    if (!IsShaderReady(shader) || sourceIndex.empty()) {
+        DrawTextureRec(scene, flipped, { 0, 0 }, WHITE);
+        return;
+    }
+
+    if (mapTextureDirty) {
+        std::vector<float> map(static_cast<size_t>(width) * height * 3);
+        for (size_t i = 0; i < sourceIndex.size(); i++) {
+            int source = sourceIndex[i];
+            map[i * 3 + 0] = source < 0 ? 0.0f : ((source % width) + 0.5f) / width;
+            map[i * 3 + 1] = source < 0 ? 0.0f : ((source / width) + 0.5f) / height;
+            map[i * 3 + 2] = source < 0 ? 0.0f : 1.0f;
+        }
+
+        if (mapTexture.id != 0) UnloadTexture(mapTexture);
+        Image image;
+        image.data = map.data();
+        image.width = width;
+        image.height = height;
+        image.mipmaps = 1;
+        image.format = PIXELFORMAT_UNCOMPRESSED_R32G32B32;
+        mapTexture = LoadTextureFromImage(image);
+        SetTextureFilter(mapTexture, TEXTURE_FILTER_POINT);
+        mapTextureDirty = false;
+    }
+
+    float resolution[2] = { static_cast<float>(width), static_cast<float>(height) };
+    BeginShaderMode(shader);
+    SetShaderValueTexture(shader, mapLocation, mapTexture);
+    SetShaderValue(shader, resolutionLocation, resolution, SHADER_UNIFORM_VEC2);
+    DrawTextureRec(scene, flipped, { 0, 0 }, WHITE);
+    EndShaderMode();
+}
+
+void GravitationalLens::UnloadGpu() {
+    if (!gpuLoaded) return;
+    if (mapTexture.id != 0) UnloadTexture(mapTexture);
+    UnloadShader(shader);
+    memset(&shader, 0, sizeof(shader));
+    memset(&mapTexture, 0, sizeof(mapTexture));
+    gpuLoaded = false;
+    mapTextureDirty = true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef GRAVITATIONAL_LENS_H
+#define GRAVITATIONAL_LENS_H
+
+#include "raylib.h"
+#include "SoftwareRenderer.h"
+#include "ThreadPool.h"
+#include <vector>
+
+// Point mass lensing as a post process. For every screen pixel the source
+// pixel it sees is precomputed once (thin lens: beta = theta - thetaE^2 / theta),
+// so applying the effect is a single lookup per pixel. The map is rebuilt only
+// when the hole moves, its radius changes or the resolution changes.
+class GravitationalLens {
+private:
+    ThreadPool& pool;
+
+    Vector2 center;
+    float einsteinRadius;
+    float shadowRadius;
+    int width;
+    int height;
+
+    std::vector<int> sourceIndex;  // -1 inside the shadow
+    std::vector<float> scratch;
+
+    // GPU path, loaded on first use
+    Shader shader;
+    Texture2D mapTexture;
+    int mapLocation;
+    int resolutionLocation;
+    bool gpuLoaded;
+    bool mapTextureDirty;
+
+    void Rebuild();
+
+public:
+    explicit GravitationalLens(ThreadPool& pool = ThreadPool::Shared());
+    ~GravitationalLens();
+
+    GravitationalLens(const GravitationalLens&) = delete;
+    GravitationalLens& operator=(const GravitationalLens&) = delete;
+
+    // All values in pixels of the target. Returns true if the map was rebuilt.
+    bool Update(Vector2 center, float einsteinRadius, float shadowRadius, int width, int height);
+
+    // CPU path, warps the renderer's framebuffer in place (multithreaded)
+    void Apply(SoftwareRenderer& renderer);
+
+    // GPU path, draws the scene texture through the lens shader.
+    // Needs a window; falls back to drawing the scene unlensed if the shader fails.
+    void Draw(Texture2D scene);
+    void UnloadGpu();
+};
+
+#endif
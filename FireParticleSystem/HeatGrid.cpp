@@ -0,0 +1,128 @@
+#include "HeatGrid.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const int DIFFUSE_ROW_GRAIN = 16;
+    const int GATHER_GRAIN = 4096;
+}
+
+HeatGrid::HeatGrid() :
+    originX(0),
+    originY(0),
+    inverseCellSize(1),
+    columns(0),
+    rows(0),
+    stride(2) {
+}
+
+void HeatGrid::Splat(const float* x, const float* y, const float* temperature, int count, float cellSize) {
+    float minX = 0, minY = 0, maxX = 0, maxY = 0;
+    for (int i = 0; i < count; i++) {
+        if (i == 0 || x[i] < minX) minX = x[i];
+        if (i == 0 || y[i] < minY) minY = y[i];
+        if (i == 0 || x[i] > maxX) maxX = x[i];
+        if (i == 0 || y[i] > maxY) maxY = y[i];
+    }
+
+    // at most about one node per particle, the field only has to be as fine
+    // as the particles are dense
+    cellSize = std::max(cellSize, 1e-3f);
+    const float maxNodes = std::max(64.0f, static_cast<float>(count));
+    for (;;) {
+        columns = static_cast<int>((maxX - minX) / cellSize) + 2;
+        rows = static_cast<int>((maxY - minY) / cellSize) + 2;
+        float nodes = static_cast<float>(columns) * static_cast<float>(rows);
+        if (nodes <= maxNodes) break;
+        cellSize *= std::max(sqrtf(nodes / maxNodes), 1.01f);
+    }
+    originX = minX;
+    originY = minY;
+    inverseCellSize = 1.0f / cellSize;
+    // padded to the SIMD width so rows can be processed 4 nodes at a time
+    stride = (columns + 2 + 3) & ~3;
+
+    const size_t nodes = static_cast<size_t>(stride) * (rows + 2);
+    field.assign(nodes, 0.0f);
+    weight.assign(nodes, 0.0f);
+    next.assign(nodes, 0.0f);
+
+    for (int i = 0; i < count; i++) {
+        float fx = (x[i] - originX) * inverseCellSize;
+        float fy = (y[i] - originY) * inverseCellSize;
+        int cx = std::min(static_cast<int>(fx), columns - 2);
+        int cy = std::min(static_cast<int>(fy), rows - 2);
+        float tx = fx - cx;
+        float ty = fy - cy;
+        int n = Node(cx, cy);
+        float w[4] = { (1 - tx) * (1 - ty), tx * (1 - ty), (1 - tx) * ty, tx * ty };
+        int corner[4] = { n, n + 1, n + stride, n + stride + 1 };
+        for (int c = 0; c < 4; c++) {
+            weight[corner[c]] += w[c];
+            field[corner[c]] += w[c] * temperature[i];
+        }
+    }
+
+    occupied.resize(nodes);
+    for (size_t n = 0; n < nodes; n++) {
+        occupied[n] = weight[n] > 0.0f ? 1.0f : 0.0f;
+        field[n] = weight[n] > 0.0f ? field[n] / weight[n] : 0.0f;
+    }
+}
+
+// Rows are independent within an iteration (Jacobi), so they are split over
+// the pool; each row runs 4 nodes at a time. Empty nodes stay 0 and are
+// masked out of their neighbours' stencils.
+void HeatGrid::Diffuse(float amount, int iterations, ThreadPool& pool) {
+    const Float4 amount4 = Float4::Set1(amount);
+    const Float4 one4 = Float4::Set1(1.0f);
+
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        const float* t = field.data();
+        const float* o = occupied.data();
+        float* out = next.data();
+        pool.ParallelFor(rows, DIFFUSE_ROW_GRAIN, [&](int begin, int end) {
+            for (int y = begin; y < end; y++) {
+                int n = Node(0, y);
+                const int rowEnd = Node(columns, y);
+                for (; n + 4 <= rowEnd; n += 4) {
+                    Float4 c = Float4::Load(t + n);
+                    Float4 oL = Float4::Load(o + n - 1), oR = Float4::Load(o + n + 1);
+                    Float4 oU = Float4::Load(o + n - stride), oD = Float4::Load(o + n + stride);
+                    Float4 sum = oL * (Float4::Load(t + n - 1) - c) + oR * (Float4::Load(t + n + 1) - c) +
+                        oU * (Float4::Load(t + n - stride) - c) + oD * (Float4::Load(t + n + stride) - c);
+                    Float4 neighbours = Max(oL + oR + oU + oD, one4);
+                    ((c + amount4 * sum / neighbours) * Float4::Load(o + n)).Store(out + n);
+                }
+                for (; n < rowEnd; n++) {
+                    float c = t[n];
+                    float sum = o[n - 1] * (t[n - 1] - c) + o[n + 1] * (t[n + 1] - c) +
+                        o[n - stride] * (t[n - stride] - c) + o[n + stride] * (t[n + stride] - c);
+                    float neighbours = std::max(o[n - 1] + o[n + 1] + o[n - stride] + o[n + stride], 1.0f);
+                    out[n] = (c + amount * sum / neighbours) * o[n];
+                }
+            }
+        });
+        field.swap(next);
+    }
+}
+
+void HeatGrid::Gather(const float* x, const float* y, float* temperature, int count, float amount,
+    ThreadPool& pool) const {
+    pool.ParallelFor(count, GATHER_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            float fx = (x[i] - originX) * inverseCellSize;
+            float fy = (y[i] - originY) * inverseCellSize;
+            int cx = std::min(static_cast<int>(fx), columns - 2);
+            int cy = std::min(static_cast<int>(fy), rows - 2);
+            float tx = fx - cx;
+            float ty = fy - cy;
+            int n = Node(cx, cy);
+            float around = (1 - ty) * ((1 - tx) * field[n] + tx * field[n + 1]) +
+                ty * ((1 - tx) * field[n + stride] + tx * field[n + stride + 1]);
+            temperature[i] += amount * (around - temperature[i]);
+        }
+    });
+}
@@ -0,0 +1,49 @@
+#pragma once
+#ifndef HEAT_GRID_H
+#define HEAT_GRID_H
+
+#include <vector>
+
+class ThreadPool;
+
+// Coarse temperature field for heat exchange between many particles.
+// Particles splat their temperature onto the cell corners (bilinear), the
+// field diffuses between occupied nodes, and each particle relaxes towards
+// the field at its position. The cost is O(particles + cells) no matter how
+// many particles share a cell.
+class HeatGrid {
+public:
+    HeatGrid();
+
+    // Sizes the grid over the points' bounding box and splats their
+    // temperatures. Cells are at least cellSize wide; the cell count is
+    // capped so a few stray points can't make the grid huge.
+    void Splat(const float* x, const float* y, const float* temperature, int count, float cellSize);
+
+    // Explicit diffusion: each occupied node moves the fraction amount
+    // towards the mean of its occupied neighbours, for the given number of
+    // iterations. amount <= 1 keeps it stable.
+    void Diffuse(float amount, int iterations, ThreadPool& pool);
+
+    // temperature[i] moves the fraction amount towards the field at (x[i], y[i])
+    void Gather(const float* x, const float* y, float* temperature, int count, float amount, ThreadPool& pool) const;
+
+    int Columns() const { return columns; }
+    int Rows() const { return rows; }
+
+private:
+    // Nodes are stored with a border of one empty node on every side, so the
+    // stencil needs no bounds checks
+    std::vector<float> field;      // mean temperature around each node
+    std::vector<float> weight;     // splat weights, 0 for empty nodes
+    std::vector<float> occupied;   // 1 or 0
+    std::vector<float> next;
+    float originX, originY;
+    float inverseCellSize;
+    int columns, rows;             // nodes without the border
+    int stride;
+
+    int Node(int x, int y) const { return (y + 1) * stride + x + 1; }
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "KeplerOrbit.h"
+#include <cmath>
+
+namespace {
+    const double KEPLER_PI = 3.14159265358979323846;
+    const double PARABOLIC_BAND = 1e-3;  // |e - 1| below this is left to the integrator
+    const int MAX_NEWTON_STEPS = 16;
+    const double NEWTON_TOLERANCE = 1e-12;
+}
+
+KeplerOrbit::KeplerOrbit() :
+    mu(0),
+    eccentricity(0),
+    semiMajorAxis(0),
+    meanMotion(0),
+    meanAnomalyAtEpoch(0),
+    epoch(0),
+    periapsisX(1), periapsisY(0),
+    normalX(0), normalY(1),
+    cachedAnomaly(0) {
+}
+
+bool KeplerOrbit::Init(Vector2 relativePosition, Vector2 velocity, double gravitationalParameter, double time) {
+    double x = relativePosition.x, y = relativePosition.y;
+    double vx = velocity.x, vy = velocity.y;
+    double r = sqrt(x * x + y * y);
+    double h = x * vy - y * vx;
+    if (r <= 0.0 || gravitationalParameter <= 0.0 || fabs(h) < 1e-9 * r) return false;
+
+    mu = gravitationalParameter;
+    double v2 = vx * vx + vy * vy;
+    double rv = x * vx + y * vy;
+    double ex = ((v2 - mu / r) * x - rv * vx) / mu;
+    double ey = ((v2 - mu / r) * y - rv * vy) / mu;
+    eccentricity = sqrt(ex * ex + ey * ey);
+    if (fabs(eccentricity - 1.0) < PARABOLIC_BAND) return false;
+
+    // perifocal frame, for circular orbits any direction works as periapsis
+    if (eccentricity > 1e-9) {
+        periapsisX = ex / eccentricity;
+        periapsisY = ey / eccentricity;
+    }
+    else {
+        periapsisX = x / r;
+        periapsisY = y / r;
+    }
+    double sense = h > 0.0 ? 1.0 : -1.0;
+    normalX = -periapsisY * sense;
+    normalY = periapsisX * sense;
+
+    double cosNu = (x * periapsisX + y * periapsisY) / r;
+    double sinNu = (x * normalX + y * normalY) / r;
+    semiMajorAxis = 1.0 / (2.0 / r - v2 / mu);
+    double e = eccentricity;
+
+    if (e < 1.0) {
+        double E = atan2(sqrt(1.0 - e * e) * sinNu, e + cosNu);
+        meanMotion = sqrt(mu / (semiMajorAxis * semiMajorAxis * semiMajorAxis));
+        meanAnomalyAtEpoch = E - e * sin(E);
+        cachedAnomaly = E;
+    }
+    else {
+        double F = 2.0 * atanh(sqrt((e - 1.0) / (e + 1.0)) * sinNu / (1.0 + cosNu));
+        double a = -semiMajorAxis;
+        meanMotion = sqrt(mu / (a * a * a));
+        meanAnomalyAtEpoch = e * sinh(F) - F;
+        cachedAnomaly = F;
+    }
+    epoch = time;
+    return true;
+}
+
+double KeplerOrbit::SolveElliptic(double meanAnomaly) {
+    const double e = eccentricity;
+    meanAnomaly = fmod(meanAnomaly, 2.0 * KEPLER_PI);
+    if (meanAnomaly > KEPLER_PI) meanAnomaly -= 2.0 * KEPLER_PI;
+    if (meanAnomaly < -KEPLER_PI) meanAnomaly += 2.0 * KEPLER_PI;
+
+    // the previous anomaly is an excellent seed when steps are small; wrap it
+    // to the same revolution, and fall back to the classic seed otherwise
+    double E = remainder(cachedAnomaly, 2.0 * KEPLER_PI);
+    if (fabs(E - meanAnomaly) > 1.0) {
+        E = e < 0.8 ? meanAnomaly : (meanAnomaly < 0 ? -KEPLER_PI : KEPLER_PI);
+    }
+
+    for (int i = 0; i < MAX_NEWTON_STEPS; i++) {
+        double f = E - e * sin(E) - meanAnomaly;
+        double step = f / (1.0 - e * cos(E));
+        E -= step;
+        if (fabs(step) < NEWTON_TOLERANCE) break;
+    }
+    cachedAnomaly = E;
+    return E;
+}
+
+double KeplerOrbit::SolveHyperbolic(double meanAnomaly) {
+    const double e = eccentricity;
+    double F = cachedAnomaly;
+    if (fabs((e * sinh(F) - F) - meanAnomaly) > fabs(meanAnomaly) + 1.0) {
+        F = asinh(meanAnomaly / e);
+    }
+
+    for (int i = 0; i < MAX_NEWTON_STEPS; i++) {
+        double f = e * sinh(F) - F - meanAnomaly;
+        double step = f / (e * cosh(F) - 1.0);
+        F -= step;
+        if (fabs(step) < NEWTON_TOLERANCE) break;
+    }
+    cachedAnomaly = F;
+    return F;
+}
+
+void KeplerOrbit::Propagate(double time, Vector2& relativePosition, Vector2& velocity) {
+    const double e = eccentricity;
+    double meanAnomaly = meanAnomalyAtEpoch + meanMotion * (time - epoch);
+    double px, py, vx, vy;
+
+    if (e < 1.0) {
+        double a = semiMajorAxis;
+        double E = SolveElliptic(meanAnomaly);
+        double cosE = cos(E), sinE = sin(E);
+        double b = sqrt(1.0 - e * e);
+        double r = a * (1.0 - e * cosE);
+        double k = sqrt(mu * a) / r;
+        px = a * (cosE - e);
+        py = a * b * sinE;
+        vx = -k * sinE;
+        vy = k * b * cosE;
+    }
+    else {
+        double a = semiMajorAxis;
+        double F = SolveHyperbolic(meanAnomaly);
+        double coshF = cosh(F), sinhF = sinh(F);
+        double b = sqrt(e * e - 1.0);
+        double r = a * (1.0 - e * coshF);
+        double k = sqrt(-mu * a) / r;
+        px = a * (coshF - e);
+        py = -a * b * sinhF;
+        vx = -k * sinhF;
+        vy = k * b * coshF;
+    }
+
+    relativePosition.x = static_cast<float>(px * periapsisX + py * normalX);
+    relativePosition.y = static_cast<float>(px * periapsisY + py * normalY);
+    velocity.x = static_cast<float>(vx * periapsisX + vy * normalX);
+    velocity.y = static_cast<float>(vx * periapsisY + vy * normalY);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#ifndef KEPLER_ORBIT_H
+#define KEPLER_ORBIT_H
+
+#include "raylib.h"
+
+// Closed-form two-body propagation around the black hole. Elliptic and
+// hyperbolic conics are supported; Kepler's equation is solved with Newton
+// iterations seeded from the previous solution, which typically converges in
+// one or two steps. Near-parabolic and radial orbits are rejected by Init()
+// and stay on the numerical integrator. Math is in double precision so long
+// time-warped runs stay stable.
+class KeplerOrbit {
+public:
+    KeplerOrbit();
+
+    // relativePosition is measured from the attracting body. Returns false if
+    // the orbit can't be propagated analytically.
+    bool Init(Vector2 relativePosition, Vector2 velocity, double mu, double time);
+
+    // State at an absolute simulation time
+    void Propagate(double time, Vector2& relativePosition, Vector2& velocity);
+
+private:
+    double mu;
+    double eccentricity;
+    double semiMajorAxis;   // negative for hyperbolic orbits
+    double meanMotion;
+    double meanAnomalyAtEpoch;
+    double epoch;
+    double periapsisX, periapsisY;  // unit vector towards periapsis
+    double normalX, normalY;        // unit vector 90 degrees ahead in the direction of motion
+    double cachedAnomaly;           // last eccentric (or hyperbolic) anomaly
+
+    double SolveElliptic(double meanAnomaly);
+    double SolveHyperbolic(double meanAnomaly);
+};
+
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Bounded lock-free queue for many producers and a single consumer, after
+// Dmitry Vyukov's bounded MPMC queue. Every cell carries a sequence number
+// that says whether it is free for the producer claiming that position or
+// holds a value for the consumer. Producers only race on the enqueue
+// position (one CAS) and fail instead of waiting when the queue is full,
+// the consumer never takes a lock.
+template <typename T>
+class MpscQueue {
+public:
+    // capacity is rounded up to a power of two
+    explicit MpscQueue(size_t capacity = 1024) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mask = size - 1;
+        cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueuePosition.store(0, std::memory_order_relaxed);
+        dequeuePosition = 0;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Any thread. Returns false when the queue is full.
+    bool TryPush(const T& value) {
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells[position & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (diff == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = value;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only. Returns false when nothing is ready.
+    bool TryPop(T& value) {
+        Cell& cell = cells[dequeuePosition & mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(dequeuePosition + 1) < 0) return false;
+        value = cell.value;
+        cell.sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+        dequeuePosition++;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+
+    // producers and the consumer touch different cache lines
+    char padding0[64];
+    std::atomic<size_t> enqueuePosition;
+    char padding1[64];
+    size_t dequeuePosition;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "NeighbourGrid.h"
+#include <algorithm>
+#include <cmath>
+
+NeighbourGrid::NeighbourGrid() :
+    radiusSquared(0),
+    columns(1),
+    rows(1) {
+}
+
+void NeighbourGrid::Build(const float* x, const float* y, int count, float radius) {
+    radiusSquared = radius * radius;
+
+    float minX = 0, minY = 0, maxX = 0, maxY = 0;
+    for (int i = 0; i < count; i++) {
+        if (i == 0 || x[i] < minX) minX = x[i];
+        if (i == 0 || y[i] < minY) minY = y[i];
+        if (i == 0 || x[i] > maxX) maxX = x[i];
+        if (i == 0 || y[i] > maxY) maxY = y[i];
+    }
+
+    // a few stray points far away must not blow up the cell count, so it is
+    // capped at a few cells per point like in UniformGrid
+    float cellSize = std::max(radius, 1e-3f);
+    const float maxCells = std::max(16.0f, 4.0f * count);
+    for (;;) {
+        columns = static_cast<int>((maxX - minX) / cellSize) + 1;
+        rows = static_cast<int>((maxY - minY) / cellSize) + 1;
+        float cells = static_cast<float>(columns) * static_cast<float>(rows);
+        if (cells <= maxCells) break;
+        cellSize *= std::max(sqrtf(cells / maxCells), 1.01f);
+    }
+    const float inverseCellSize = 1.0f / cellSize;
+
+    cellOf.resize(count);
+    cellStart.assign(columns * rows + 1, 0);
+    for (int i = 0; i < count; i++) {
+        int cx = std::min(static_cast<int>((x[i] - minX) * inverseCellSize), columns - 1);
+        int cy = std::min(static_cast<int>((y[i] - minY) * inverseCellSize), rows - 1);
+        cellOf[i] = cy * columns + cx;
+        cellStart[cellOf[i] + 1]++;
+    }
+    for (size_t c = 1; c < cellStart.size(); c++) {
+        cellStart[c] += cellStart[c - 1];
+    }
+
+    order.resize(count);
+    sortedX.resize(count);
+    sortedY.resize(count);
+    cellX.resize(count);
+    cellY.resize(count);
+    std::vector<int> cursor(cellStart.begin(), cellStart.end() - 1);
+    for (int i = 0; i < count; i++) {
+        int k = cursor[cellOf[i]]++;
+        order[k] = i;
+        sortedX[k] = x[i];
+        sortedY[k] = y[i];
+        cellX[k] = cellOf[i] % columns;
+        cellY[k] = cellOf[i] / columns;
+    }
+}
+
+void NeighbourGrid::Gather(const float* values, float* sorted) const {
+    for (size_t k = 0; k < order.size(); k++) {
+        sorted[k] = values[order[k]];
+    }
+}
+
+void NeighbourGrid::Scatter(const float* sorted, float* values) const {
+    for (size_t k = 0; k < order.size(); k++) {
+        values[order[k]] = sorted[k];
+    }
+}
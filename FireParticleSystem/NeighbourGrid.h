@@ -0,0 +1,78 @@
+#pragma once
+#ifndef NEIGHBOUR_GRID_H
+#define NEIGHBOUR_GRID_H
+
+#include "Simd.h"
+#include <cstddef>
+#include <vector>
+
+// Fixed-radius neighbour search over points. Cells are one radius wide, so
+// every neighbour is in the 3x3 block around a point's cell. Points are
+// counting-sorted by cell (stable, so the order only depends on the input)
+// and the grid keeps sorted copies of the coordinates: a cell is a
+// contiguous range, and so are the three cells of each row of the block.
+//
+// Solvers can work on the sorted copies directly (Gather/Scatter move other
+// per-point data into and out of grid order), which keeps neighbour reads
+// local in memory.
+class NeighbourGrid {
+public:
+    NeighbourGrid();
+
+    void Build(const float* x, const float* y, int count, float radius);
+
+    int Size() const { return static_cast<int>(order.size()); }
+    // Input index of the point at sorted position k
+    int Original(int k) const { return order[k]; }
+    const float* SortedX() const { return sortedX.data(); }
+    const float* SortedY() const { return sortedY.data(); }
+
+    // Calls f(j) for every sorted position j within the radius of sorted
+    // position k, itself excluded, in grid order. Stops when f returns false.
+    // Candidates are tested 4 at a time and only the hits branch.
+    template <typename F>
+    void VisitNeighbours(int k, F f) const {
+        const float px = sortedX[k];
+        const float py = sortedY[k];
+        const Float4 px4 = Float4::Set1(px);
+        const Float4 py4 = Float4::Set1(py);
+        const Float4 reach4 = Float4::Set1(radiusSquared);
+        const int cx = cellX[k];
+        const int cy = cellY[k];
+        const int x0 = cx > 0 ? cx - 1 : 0;
+        const int x1 = cx + 1 < columns ? cx + 1 : columns - 1;
+        for (int y = cy > 0 ? cy - 1 : 0; y <= cy + 1 && y < rows; y++) {
+            int j = cellStart[y * columns + x0];
+            const int end = cellStart[y * columns + x1 + 1];
+            for (; j + 4 <= end; j += 4) {
+                Float4 dx = Float4::Load(&sortedX[j]) - px4;
+                Float4 dy = Float4::Load(&sortedY[j]) - py4;
+                int hits = LessMask(dx * dx + dy * dy, reach4);
+                for (int lane = 0; hits; lane++, hits >>= 1) {
+                    if ((hits & 1) && j + lane != k && !f(j + lane)) return;
+                }
+            }
+            for (; j < end; j++) {
+                float dx = sortedX[j] - px;
+                float dy = sortedY[j] - py;
+                if (dx * dx + dy * dy < radiusSquared && j != k && !f(j)) return;
+            }
+        }
+    }
+
+    // sorted[k] = values[Original(k)]
+    void Gather(const float* values, float* sorted) const;
+    // values[Original(k)] = sorted[k]
+    void Scatter(const float* sorted, float* values) const;
+
+private:
+    std::vector<int> order;
+    std::vector<float> sortedX, sortedY;
+    std::vector<int> cellX, cellY;  // per sorted position
+    std::vector<int> cellStart;     // cell c is [cellStart[c], cellStart[c + 1])
+    std::vector<int> cellOf;        // per input point, scratch
+    float radiusSquared;
+    int columns, rows;
+};
+
+#endif
@@ -0,0 +1,229 @@
+#pragma once
+#ifndef PARTICLE_POOL_H
+#define PARTICLE_POOL_H
+
+#include "raylib.h"
+#include "Simd.h"
+#include <cstddef>
+#include <vector>
+
+// Particles stored as float columns, with the components, the integrator and
+// the forces picked at compile time:
+//
+//   Layout      names the columns: an enum Column ending in COLUMNS
+//   Integrator  template <typename Layout> class, Advance(p, ax, ay) moves a
+//               particle by an acceleration
+//   Force       template <typename Layout> class, Apply(p, ax, ay) computes
+//               the acceleration and may update other columns
+//
+// Step() instantiates Force::Apply and Integrator::Advance for Float4 and
+// for float, so each configuration gets its own inlined loop, 4 particles at
+// a time with a scalar tail, and no virtual call. Both are the same code on
+// a different lane type, so the tail agrees with the lanes bit for bit. A
+// policy only compiles against a layout that has the columns it uses.
+
+// Loads and stores of one lane type
+template <typename V> struct LaneOps;
+
+template <> struct LaneOps<float> {
+    static float Load(const float* p) { return *p; }
+    static void Store(float value, float* p) { *p = value; }
+    static float Set1(float x) { return x; }
+};
+
+template <> struct LaneOps<Float4> {
+    static Float4 Load(const float* p) { return Float4::Load(p); }
+    static void Store(Float4 value, float* p) { value.Store(p); }
+    static Float4 Set1(float x) { return Float4::Set1(x); }
+};
+
+// The particles at index, index + 1, ... as seen by a policy
+template <typename Layout, typename V>
+class ParticleLanes {
+public:
+    ParticleLanes(float* const* columns, size_t index) : columns(columns), index(index) {}
+
+    V Get(typename Layout::Column column) const { return LaneOps<V>::Load(columns[column] + index); }
+    void Set(typename Layout::Column column, V value) const { LaneOps<V>::Store(value, columns[column] + index); }
+    static V Constant(float x) { return LaneOps<V>::Set1(x); }
+
+private:
+    float* const* columns;
+    size_t index;
+};
+
+template <typename Layout, template <typename> class Integrator, template <typename> class Force>
+class ParticlePool {
+public:
+    typedef typename Layout::Column Column;
+    typedef Integrator<Layout> IntegratorType;
+    typedef Force<Layout> ForceType;
+    static const int COLUMNS = Layout::COLUMNS;
+
+    size_t Size() const { return columns[0].size(); }
+    std::vector<float>& operator[](Column column) { return columns[column]; }
+    const std::vector<float>& operator[](Column column) const { return columns[column]; }
+
+    void Resize(size_t size) {
+        for (std::vector<float>& column : columns) column.resize(size);
+    }
+    void Clear() {
+        for (std::vector<float>& column : columns) column.clear();
+    }
+    // Appends a particle with every component 0 and returns its index
+    size_t Add() {
+        for (std::vector<float>& column : columns) column.push_back(0.0f);
+        return Size() - 1;
+    }
+    // The last particle takes i's place
+    void Remove(size_t i) {
+        for (std::vector<float>& column : columns) {
+            column[i] = column.back();
+            column.pop_back();
+        }
+    }
+    void Copy(size_t to, size_t from) {
+        for (std::vector<float>& column : columns) column[to] = column[from];
+    }
+
+    // Runs substeps over [begin, end). Particles don't interact here, so
+    // disjoint ranges can be stepped on different threads.
+    void Step(size_t begin, size_t end, int substeps, const ForceType& force, const IntegratorType& integrator) {
+        float* data[COLUMNS];
+        for (int c = 0; c < COLUMNS; c++) data[c] = columns[c].data();
+
+        for (int s = 0; s < substeps; s++) {
+            size_t i = begin;
+            for (; i + 4 <= end; i += 4) {
+                StepLanes(ParticleLanes<Layout, Float4>(data, i), force, integrator);
+            }
+            for (; i < end; i++) {
+                StepLanes(ParticleLanes<Layout, float>(data, i), force, integrator);
+            }
+        }
+    }
+
+private:
+    std::vector<float> columns[COLUMNS];
+
+    template <typename V>
+    static void StepLanes(const ParticleLanes<Layout, V>& p, const ForceType& force, const IntegratorType& integrator) {
+        V ax, ay;
+        force.Apply(p, ax, ay);
+        integrator.Advance(p, ax, ay);
+    }
+};
+
+// Position Verlet with velocity damping: x' = x + (x - x_old) * damping + a * dt^2.
+// Needs X, Y, OLD_X, OLD_Y.
+template <typename Layout>
+class VerletIntegrator {
+public:
+    VerletIntegrator(float dt, float damping) : dt2(dt * dt), damping(damping) {}
+
+    template <typename V>
+    void Advance(const ParticleLanes<Layout, V>& p, V ax, V ay) const {
+        typedef ParticleLanes<Layout, V> Lanes;
+        V x = p.Get(Layout::X);
+        V y = p.Get(Layout::Y);
+        V nx = x + (x - p.Get(Layout::OLD_X)) * Lanes::Constant(damping) + ax * Lanes::Constant(dt2);
+        V ny = y + (y - p.Get(Layout::OLD_Y)) * Lanes::Constant(damping) + ay * Lanes::Constant(dt2);
+        p.Set(Layout::OLD_X, x);
+        p.Set(Layout::OLD_Y, y);
+        p.Set(Layout::X, nx);
+        p.Set(Layout::Y, ny);
+    }
+
+private:
+    float dt2;
+    float damping;
+};
+
+// Semi-implicit Euler: the velocity takes the kick, then the position moves
+// with the new velocity. Needs X, Y, VELOCITY_X, VELOCITY_Y.
+template <typename Layout>
+class EulerIntegrator {
+public:
+    explicit EulerIntegrator(float dt) : dt(dt) {}
+
+    template <typename V>
+    void Advance(const ParticleLanes<Layout, V>& p, V ax, V ay) const {
+        V x = p.Get(Layout::X), y = p.Get(Layout::Y);
+        V vx = p.Get(Layout::VELOCITY_X), vy = p.Get(Layout::VELOCITY_Y);
+        Advance(x, y, vx, vy, ax, ay);
+        p.Set(Layout::X, x);
+        p.Set(Layout::Y, y);
+        p.Set(Layout::VELOCITY_X, vx);
+        p.Set(Layout::VELOCITY_Y, vy);
+    }
+
+    // The same step on values, for particles kept outside a pool
+    template <typename V>
+    void Advance(V& x, V& y, V& vx, V& vy, V ax, V ay) const {
+        const V step = LaneOps<V>::Set1(dt);
+        vx = vx + ax * step;
+        vy = vy + ay * step;
+        x = x + vx * step;
+        y = y + vy * step;
+    }
+
+private:
+    float dt;
+};
+
+// Hot particles rise: the temperature relaxes towards ambient by cooling per
+// step, buoyancy lifts by how much hotter than ambient the particle still
+// is, on top of its own ACCELERATION_X/Y, and LIFETIME burns down by dt.
+template <typename Layout>
+class BuoyancyForce {
+public:
+    BuoyancyForce(float dt, float ambient, float cooling, float buoyancy) :
+        dt(dt), ambient(ambient), cooling(cooling), buoyancy(buoyancy) {}
+
+    template <typename V>
+    void Apply(const ParticleLanes<Layout, V>& p, V& ax, V& ay) const {
+        typedef ParticleLanes<Layout, V> Lanes;
+        const V ambient4 = Lanes::Constant(ambient);
+        V t = ambient4 + (p.Get(Layout::TEMPERATURE) - ambient4) * Lanes::Constant(cooling);
+        p.Set(Layout::TEMPERATURE, t);
+        ax = p.Get(Layout::ACCELERATION_X);
+        // screen y points down
+        ay = p.Get(Layout::ACCELERATION_Y) - Lanes::Constant(buoyancy) * (t - ambient4);
+        p.Set(Layout::LIFETIME, p.Get(Layout::LIFETIME) - Lanes::Constant(dt));
+    }
+
+private:
+    float dt, ambient, cooling, buoyancy;
+};
+
+// Inverse-square pull towards a point, capped at maxAcceleration. Needs X, Y.
+template <typename Layout>
+class PointGravityForce {
+public:
+    PointGravityForce(Vector2 center, float strength, float maxAcceleration) :
+        center(center), strength(strength), maxAcceleration(maxAcceleration) {}
+
+    template <typename V>
+    void Apply(const ParticleLanes<Layout, V>& p, V& ax, V& ay) const {
+        Accelerate(p.Get(Layout::X), p.Get(Layout::Y), ax, ay);
+    }
+
+    // The same pull on values, for particles kept outside a pool
+    template <typename V>
+    void Accelerate(V x, V y, V& ax, V& ay) const {
+        V dx = LaneOps<V>::Set1(center.x) - x;
+        V dy = LaneOps<V>::Set1(center.y) - y;
+        V distSq = dx * dx + dy * dy;
+        V dist = Sqrt(distSq);
+        V magnitude = Min(LaneOps<V>::Set1(strength) / distSq, LaneOps<V>::Set1(maxAcceleration));
+        ax = dx / dist * magnitude;
+        ay = dy / dist * magnitude;
+    }
+
+private:
+    Vector2 center;
+    float strength;
+    float maxAcceleration;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#include "RailParticles.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <cmath>
+
+namespace {
+    const float TWO_PI = 6.28318530718f;
+    const int ADVANCE_GRAIN = 65536;  // multiple of the SIMD width
+}
+
+void RailParticles::Add(float r, float angle, float angularVelocity, float life) {
+    radius.push_back(r);
+    theta.push_back(fmodf(angle + TWO_PI, TWO_PI));
+    omega.push_back(angularVelocity);
+    lifetime.push_back(life);
+}
+
+void RailParticles::Clear() {
+    radius.clear();
+    theta.clear();
+    omega.clear();
+    lifetime.clear();
+}
+
+void RailParticles::Advance(float dt, float drift) {
+    float* r = radius.data();
+    float* t = theta.data();
+    const float* w = omega.data();
+
+    const Float4 step = Float4::Set1(dt);
+    const Float4 fall = Float4::Set1(drift * dt);
+    const Float4 twoPi = Float4::Set1(TWO_PI);
+
+    // chunk starts are multiples of 4, so only the last chunk has a scalar tail
+    ThreadPool::Shared().ParallelFor(static_cast<int>(Size()), ADVANCE_GRAIN, [&](int begin, int end) {
+        int i = begin;
+        for (; i + 4 <= end; i += 4) {
+            Float4 angle = Float4::Load(t + i) + Float4::Load(w + i) * step;
+            // keep theta in [0, 2pi) so precision doesn't degrade over long runs
+            angle = SelectLess(angle, twoPi, angle, angle - twoPi);
+            angle.Store(t + i);
+            (Float4::Load(r + i) - fall).Store(r + i);
+        }
+        for (; i < end; i++) {
+            t[i] += w[i] * dt;
+            if (t[i] >= TWO_PI) t[i] -= TWO_PI;
+            r[i] -= drift * dt;
+        }
+    });
+}
+
+void RailParticles::Release(Vector2 center, float innerRadius, const std::vector<Perturber>& perturbers, float drift,
+    std::vector<Vector2>& positions, std::vector<Vector2>& velocities, std::vector<float>& lifetimes) {
+
+    // in polar form a perturber only matters for the annulus it overlaps,
+    // which rejects most particles by radius alone
+    std::vector<float> perturberRadius(perturbers.size());
+    for (size_t p = 0; p < perturbers.size(); p++) {
+        float dx = perturbers[p].position.x - center.x;
+        float dy = perturbers[p].position.y - center.y;
+        perturberRadius[p] = sqrtf(dx * dx + dy * dy);
+    }
+
+    auto mustRelease = [&](size_t i) {
+        if (radius[i] < innerRadius) return true;
+        for (size_t p = 0; p < perturbers.size(); p++) {
+            float reach = perturbers[p].radius;
+            if (fabsf(radius[i] - perturberRadius[p]) > reach) continue;
+
+            Vector2 pos = Position(i, center);
+            float dx = pos.x - perturbers[p].position.x;
+            float dy = pos.y - perturbers[p].position.y;
+            if (dx * dx + dy * dy < reach * reach) return true;
+        }
+        return false;
+    };
+
+    // SIMD scan for candidates, the exact test only runs on flagged lanes
+    std::vector<size_t> released;
+    const size_t count = Size();
+    const Float4 inner = Float4::Set1(innerRadius);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        Float4 r = Float4::Load(&radius[i]);
+        int mask = LessMask(r, inner);
+        for (size_t p = 0; p < perturbers.size(); p++) {
+            Float4 low = Float4::Set1(perturberRadius[p] - perturbers[p].radius);
+            Float4 high = Float4::Set1(perturberRadius[p] + perturbers[p].radius);
+            mask |= LessMask(low, r) & LessMask(r, high);
+        }
+        if (mask == 0) continue;
+
+        for (int lane = 0; lane < 4; lane++) {
+            if ((mask & (1 << lane)) && mustRelease(i + lane)) released.push_back(i + lane);
+        }
+    }
+    for (; i < count; i++) {
+        if (mustRelease(i)) released.push_back(i);
+    }
+
+    // highest index first, so swap-removal only moves particles already checked
+    for (size_t k = released.size(); k-- > 0;) {
+        size_t index = released[k];
+        positions.push_back(Position(index, center));
+        velocities.push_back(Velocity(index, drift));
+        lifetimes.push_back(lifetime[index]);
+        RemoveAt(index);
+    }
+}
+
+Vector2 RailParticles::Position(size_t i, Vector2 center) const {
+    return {
+        center.x + cosf(theta[i]) * radius[i],
+        center.y + sinf(theta[i]) * radius[i]
+    };
+}
+
+Vector2 RailParticles::Velocity(size_t i, float drift) const {
+    float c = cosf(theta[i]);
+    float s = sinf(theta[i]);
+    float tangential = omega[i] * radius[i];
+    return {
+        -s * tangential - c * drift,
+        c * tangential - s * drift
+    };
+}
+
+void RailParticles::RemoveAt(size_t i) {
+    radius[i] = radius.back();
+    theta[i] = theta.back();
+    omega[i] = omega.back();
+    lifetime[i] = lifetime.back();
+    radius.pop_back();
+    theta.pop_back();
+    omega.pop_back();
+    lifetime.pop_back();
+}
@@ -0,0 +1,47 @@
+#pragma once
+#ifndef RAIL_PARTICLES_H
+#define RAIL_PARTICLES_H
+
+#include "raylib.h"
+#include <cstddef>
+#include <vector>
+
+// Accretion particles "on rails": unperturbed particles on circular orbits
+// stored in polar form (SoA), so a step is theta += omega * dt plus a slow
+// inward drift for the whole disk. Particles leave the rails when they drift
+// inside the inner radius or a planet comes close, and are then handed back
+// to the full Cartesian integrator.
+class RailParticles {
+public:
+    struct Perturber {
+        Vector2 position;
+        float radius;
+    };
+
+    std::vector<float> radius;
+    std::vector<float> theta;
+    std::vector<float> omega;
+    std::vector<float> lifetime;
+
+    size_t Size() const { return radius.size(); }
+
+    void Add(float r, float angle, float angularVelocity, float life);
+    void Clear();
+
+    // theta += omega * dt and r -= drift * dt for every particle, 4 at a time
+    // and split across the shared thread pool
+    void Advance(float dt, float drift);
+
+    // Removes particles that must be integrated numerically and appends their
+    // Cartesian state to the output vectors
+    void Release(Vector2 center, float innerRadius, const std::vector<Perturber>& perturbers, float drift,
+        std::vector<Vector2>& positions, std::vector<Vector2>& velocities, std::vector<float>& lifetimes);
+
+    Vector2 Position(size_t i, Vector2 center) const;
+    Vector2 Velocity(size_t i, float drift) const;
+
+private:
+    void RemoveAt(size_t i);
+};
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+// Small seedable generator (xorshift64*). Unlike rand() its whole state is one
+// integer, so it can be saved with the simulation and replayed exactly.
+class Random {
+public:
+    explicit Random(uint64_t seed = 0x9e3779b97f4a7c15ull) { SetState(seed); }
+
+    uint64_t State() const { return state; }
+    void SetState(uint64_t s) { state = s ? s : 0x9e3779b97f4a7c15ull; }
+
+    uint32_t Next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return static_cast<uint32_t>((state * 0x2545f4914f6cdd1dull) >> 32);
+    }
+
+    // Uniform in [min, max)
+    float GetFloat(float min, float max) {
+        return min + (Next() >> 8) * (1.0f / 16777216.0f) * (max - min);
+    }
+
+private:
+    uint64_t state;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+#ifndef RAYLIB_RENDERER_H
+#define RAYLIB_RENDERER_H
+
+#include "raylib.h"
+#include "RenderBatch.h"
+
+// Forwards the drawing calls used by the simulation to raylib's GPU path.
+// SoftwareRenderer implements the same calls on the CPU, Draw() functions
+// are templated on the renderer so neither path pays for dispatch.
+// With a ParticleRenderBatch, room is reserved in it before every shape.
+struct RaylibRenderer {
+    ParticleRenderBatch* batch;
+
+    explicit RaylibRenderer(ParticleRenderBatch* batch = nullptr) : batch(batch) {}
+
+    void Reserve(int vertexCount) {
+        if (batch) batch->Reserve(vertexCount);
+    }
+
+    void BeginBlendMode(int mode) { ::BeginBlendMode(mode); }
+    void EndBlendMode() { ::EndBlendMode(); }
+
+    void DrawCircle(float centerX, float centerY, float radius, Color color) {
+        Reserve(ParticleRenderBatch::CIRCLE_VERTICES);
+        ::DrawCircle(static_cast<int>(centerX), static_cast<int>(centerY), radius, color);
+    }
+
+    void DrawCircleV(Vector2 center, float radius, Color color) {
+        Reserve(ParticleRenderBatch::CIRCLE_VERTICES);
+        ::DrawCircleV(center, radius, color);
+    }
+
+    void DrawCircleGradient(float centerX, float centerY, float radius, Color inner, Color outer) {
+        Reserve(ParticleRenderBatch::GRADIENT_VERTICES);
+        ::DrawCircleGradient(static_cast<int>(centerX), static_cast<int>(centerY), radius, inner, outer);
+    }
+
+    void DrawLineV(Vector2 start, Vector2 end, Color color) {
+        Reserve(ParticleRenderBatch::LINE_VERTICES);
+        ::DrawLineV(start, end, color);
+    }
+
+    void SplatGlow(Vector2 center, float radius, Color color) {
+        Reserve(ParticleRenderBatch::CIRCLE_VERTICES);
+        ::DrawCircleV(center, radius, color);
+    }
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "RenderBatch.h"
+#include <algorithm>
+
+ParticleRenderBatch::ParticleRenderBatch() :
+    batch(),
+    elements(0),
+    loaded(false),
+    active(false),
+    flushes(0),
+    flushesLastFrame(0),
+    lastDrawCounter(0) {
+}
+
+ParticleRenderBatch::~ParticleRenderBatch() {
+    Unload();
+}
+
+void ParticleRenderBatch::Begin(int vertexCount) {
+    int wanted = std::min(std::max((vertexCount + 3) / 4, static_cast<int>(MIN_ELEMENTS)), static_cast<int>(MAX_ELEMENTS));
+
+    // grow with headroom so a slowly rising particle count doesn't reload every frame
+    if (!loaded || wanted > elements) {
+        Unload();
+        elements = std::min(wanted + wanted / 2, static_cast<int>(MAX_ELEMENTS));
+        batch = rlLoadRenderBatch(BUFFER_COUNT, elements);
+        loaded = true;
+    }
+
+    rlSetRenderBatchActive(&batch);
+    active = true;
+    flushes = 0;
+    lastDrawCounter = batch.drawCounter;
+}
+
+// rlgl also flushes on its own when the draw call array fills up, which shows
+// up as the draw counter going back down
+void ParticleRenderBatch::CountImplicitFlush() {
+    if (batch.drawCounter < lastDrawCounter) flushes++;
+    lastDrawCounter = batch.drawCounter;
+}
+
+void ParticleRenderBatch::Reserve(int vertexCount) {
+    if (!active) return;
+    CountImplicitFlush();
+    if (rlCheckRenderBatchLimit(vertexCount)) {
+        flushes++;
+        lastDrawCounter = batch.drawCounter;
+    }
+}
+
+void ParticleRenderBatch::End() {
+    if (!active) return;
+    CountImplicitFlush();
+
+    // switching back submits this batch
+    rlSetRenderBatchActive(nullptr);
+    flushes++;
+    flushesLastFrame = flushes;
+    active = false;
+}
+
+void ParticleRenderBatch::Unload() {
+    if (!loaded) return;
+    if (active) End();
+    rlUnloadRenderBatch(batch);
+    batch = rlRenderBatch();
+    loaded = false;
+    elements = 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#ifndef RENDER_BATCH_H
+#define RENDER_BATCH_H
+
+#include "raylib.h"
+#include "rlgl.h"
+
+// Dedicated multi-buffered rlgl batch for the particle and disk layers.
+// raylib's default batch is a single 8192 element buffer with 256 draw calls,
+// so large particle counts keep forcing flushes that wait on the buffer that
+// was just submitted. This batch is sized to the live geometry and rotates
+// through several vertex buffers, and it counts the flushes of each frame.
+class ParticleRenderBatch {
+public:
+    static const int BUFFER_COUNT = 3;
+    static const int MIN_ELEMENTS = RL_DEFAULT_BATCH_BUFFER_ELEMENTS;
+    static const int MAX_ELEMENTS = 1 << 17;  // ~13 MB of vertex data per buffer
+
+    // Vertex counts of the raylib shapes the simulation draws
+    static const int CIRCLE_VERTICES = 72;     // 36 segments as quads
+    static const int GRADIENT_VERTICES = 108;  // 36 triangles
+    static const int LINE_VERTICES = 2;
+
+    ParticleRenderBatch();
+    ~ParticleRenderBatch();
+
+    ParticleRenderBatch(const ParticleRenderBatch&) = delete;
+    ParticleRenderBatch& operator=(const ParticleRenderBatch&) = delete;
+
+    // Makes the batch active, growing it first if vertexCount would not fit
+    void Begin(int vertexCount);
+
+    // Call before submitting vertexCount vertices, flushes up front if they
+    // would overflow the current buffer
+    void Reserve(int vertexCount);
+
+    // Submits what is left and restores raylib's default batch
+    void End();
+
+    void Unload();
+
+    int FlushesLastFrame() const { return flushesLastFrame; }
+    int Elements() const { return elements; }
+
+private:
+    rlRenderBatch batch;
+    int elements;
+    bool loaded;
+    bool active;
+    int flushes;
+    int flushesLastFrame;
+    int lastDrawCounter;
+
+    void CountImplicitFlush();
+};
+
+#endif
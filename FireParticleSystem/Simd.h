@@ -0,0 +1,93 @@
+#pragma once
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+
+// 4-wide float vector used by the hot loops. Maps to SSE on x86/x64 and
+// falls back to plain scalar code everywhere else.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define SIMD_USE_SSE 0
+#endif
+
+struct Float4 {
+#if SIMD_USE_SSE
+    __m128 v;
+
+    Float4() {}
+    Float4(__m128 value) : v(value) {}
+
+    static Float4 Load(const float* p) { return _mm_loadu_ps(p); }
+    static Float4 Set1(float x) { return _mm_set1_ps(x); }
+    static Float4 Set(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+    void Store(float* p) const { _mm_storeu_ps(p, v); }
+    // Truncates towards zero
+    void StoreInt(int* p) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_cvttps_epi32(v)); }
+
+    friend Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+    friend Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+    friend Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+    friend Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.v, b.v); }
+    friend Float4 Min(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+    friend Float4 Max(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+    friend Float4 Sqrt(Float4 a) { return _mm_sqrt_ps(a.v); }
+
+    // Per-lane a < b ? x : y
+    friend Float4 SelectLess(Float4 a, Float4 b, Float4 x, Float4 y) {
+        __m128 mask = _mm_cmplt_ps(a.v, b.v);
+        return _mm_or_ps(_mm_and_ps(mask, x.v), _mm_andnot_ps(mask, y.v));
+    }
+
+    // Bit i set when lane i of a is less than lane i of b
+    friend int LessMask(Float4 a, Float4 b) { return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v)); }
+#else
+    float v[4];
+
+    Float4() {}
+
+    static Float4 Load(const float* p) { return Set(p[0], p[1], p[2], p[3]); }
+    static Float4 Set1(float x) { return Set(x, x, x, x); }
+    static Float4 Set(float a, float b, float c, float d) {
+        Float4 r;
+        r.v[0] = a; r.v[1] = b; r.v[2] = c; r.v[3] = d;
+        return r;
+    }
+    void Store(float* p) const { for (int i = 0; i < 4; i++) p[i] = v[i]; }
+    void StoreInt(int* p) const { for (int i = 0; i < 4; i++) p[i] = static_cast<int>(v[i]); }
+
+#define SIMD_FLOAT4_LANES(expr) Float4 r; for (int i = 0; i < 4; i++) r.v[i] = (expr); return r;
+    friend Float4 operator+(Float4 a, Float4 b) { SIMD_FLOAT4_LANES(a.v[i] + b.v[i]) }
+    friend Float4 operator-(Float4 a, Float4 b) { SIMD_FLOAT4_LANES(a.v[i] - b.v[i]) }
+    friend Float4 operator*(Float4 a, Float4 b) { SIMD_FLOAT4_LANES(a.v[i] * b.v[i]) }
+    friend Float4 operator/(Float4 a, Float4 b) { SIMD_FLOAT4_LANES(a.v[i] / b.v[i]) }
+    friend Float4 Min(Float4 a, Float4 b) { SIMD_FLOAT4_LANES(b.v[i] < a.v[i] ? b.v[i] : a.v[i]) }
+    friend Float4 Max(Float4 a, Float4 b) { SIMD_FLOAT4_LANES(a.v[i] < b.v[i] ? b.v[i] : a.v[i]) }
+    friend Float4 Sqrt(Float4 a) { SIMD_FLOAT4_LANES(sqrtf(a.v[i])) }
+    friend Float4 SelectLess(Float4 a, Float4 b, Float4 x, Float4 y) { SIMD_FLOAT4_LANES(a.v[i] < b.v[i] ? x.v[i] : y.v[i]) }
+    friend int LessMask(Float4 a, Float4 b) {
+        int mask = 0;
+        for (int i = 0; i < 4; i++) if (a.v[i] < b.v[i]) mask |= 1 << i;
+        return mask;
+    }
+#undef SIMD_FLOAT4_LANES
+#endif
+
+    Float4& operator+=(Float4 b) { *this = *this + b; return *this; }
+    Float4& operator-=(Float4 b) { *this = *this - b; return *this; }
+    Float4& operator*=(Float4 b) { *this = *this * b; return *this; }
+};
+
+// Scalar counterparts with the same results as the SSE instructions, so a
+// kernel templated on its lane type compiles for Float4 and for float
+inline float Min(float a, float b) { return a < b ? a : b; }
+inline float Max(float a, float b) { return a > b ? a : b; }
+inline float Sqrt(float a) { return sqrtf(a); }
+
+inline Float4 Clamp01(Float4 a) {
+    return Min(Max(a, Float4::Set1(0.0f)), Float4::Set1(1.0f));
+}
+
+#endif
@@ -0,0 +1,149 @@
+#pragma once
+#ifndef SLOT_MAP_H
+#define SLOT_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Stable reference into a SlotMap. The generation changes every time a slot
+// is reused, so a handle to a removed element never resolves to a newer one.
+struct SlotHandle {
+    uint32_t index;
+    uint32_t generation;
+
+    static SlotHandle Null() { return { 0xffffffffu, 0 }; }
+    bool IsNull() const { return index == 0xffffffffu; }
+
+    friend bool operator==(SlotHandle a, SlotHandle b) { return a.index == b.index && a.generation == b.generation; }
+    friend bool operator!=(SlotHandle a, SlotHandle b) { return !(a == b); }
+};
+
+// Dense storage with O(1) insert, remove and lookup through handles.
+// Elements live contiguously (removal swaps the last element into the hole),
+// so iteration is a plain vector walk, while handles go through a slot table
+// that is updated whenever an element moves.
+template <typename T>
+class SlotMap {
+public:
+    SlotMap() : freeHead(NONE) {}
+
+    SlotHandle Insert(const T& value) {
+        uint32_t slot;
+        if (freeHead != NONE) {
+            slot = freeHead;
+            freeHead = slots[slot].target;
+        }
+        else {
+            slot = static_cast<uint32_t>(slots.size());
+            slots.push_back({ 0, 0 });
+        }
+        slots[slot].target = static_cast<uint32_t>(values.size());
+        values.push_back(value);
+        denseToSlot.push_back(slot);
+        return { slot, slots[slot].generation };
+    }
+
+    bool Remove(SlotHandle handle) {
+        if (!Contains(handle)) return false;
+        uint32_t dense = slots[handle.index].target;
+        uint32_t last = static_cast<uint32_t>(values.size()) - 1;
+        if (dense != last) {
+            values[dense] = values[last];
+            denseToSlot[dense] = denseToSlot[last];
+            slots[denseToSlot[dense]].target = dense;
+        }
+        values.pop_back();
+        denseToSlot.pop_back();
+
+        slots[handle.index].generation++;
+        slots[handle.index].target = freeHead;
+        freeHead = handle.index;
+        return true;
+    }
+
+    bool Contains(SlotHandle handle) const {
+        return handle.index < slots.size() && slots[handle.index].generation == handle.generation &&
+            !IsFree(handle.index);
+    }
+
+    T* Get(SlotHandle handle) { return Contains(handle) ? &values[slots[handle.index].target] : nullptr; }
+    const T* Get(SlotHandle handle) const { return Contains(handle) ? &values[slots[handle.index].target] : nullptr; }
+
+    // Handle of the element at a dense position
+    SlotHandle HandleAt(size_t dense) const {
+        uint32_t slot = denseToSlot[dense];
+        return { slot, slots[slot].generation };
+    }
+
+    size_t Size() const { return values.size(); }
+    bool Empty() const { return values.empty(); }
+    void Clear() {
+        for (uint32_t slot : denseToSlot) {
+            slots[slot].generation++;
+            slots[slot].target = freeHead;
+            freeHead = slot;
+        }
+        values.clear();
+        denseToSlot.clear();
+    }
+
+    T& operator[](size_t dense) { return values[dense]; }
+    const T& operator[](size_t dense) const { return values[dense]; }
+
+    // Dense elements, for iteration and column-wise serialization
+    std::vector<T>& Values() { return values; }
+    const std::vector<T>& Values() const { return values; }
+
+    typename std::vector<T>::iterator begin() { return values.begin(); }
+    typename std::vector<T>::iterator end() { return values.end(); }
+    typename std::vector<T>::const_iterator begin() const { return values.begin(); }
+    typename std::vector<T>::const_iterator end() const { return values.end(); }
+
+    // The slot table as plain integers, so generations survive a save and
+    // load. The element count must match Values() when loading.
+    void SaveIndex(std::vector<uint32_t>& out) const {
+        out.clear();
+        out.push_back(freeHead);
+        out.push_back(static_cast<uint32_t>(slots.size()));
+        for (const Slot& slot : slots) {
+            out.push_back(slot.target);
+            out.push_back(slot.generation);
+        }
+        out.insert(out.end(), denseToSlot.begin(), denseToSlot.end());
+    }
+
+    bool LoadIndex(const std::vector<uint32_t>& in) {
+        if (in.size() < 2) return false;
+        size_t slotCount = in[1];
+        if (in.size() != 2 + slotCount * 2 + values.size()) return false;
+        freeHead = in[0];
+        slots.resize(slotCount);
+        for (size_t i = 0; i < slotCount; i++) {
+            slots[i].target = in[2 + i * 2];
+            slots[i].generation = in[3 + i * 2];
+        }
+        denseToSlot.assign(in.begin() + 2 + slotCount * 2, in.end());
+        return true;
+    }
+
+private:
+    static const uint32_t NONE = 0xffffffffu;
+
+    struct Slot {
+        uint32_t target;      // dense index while in use, next free slot otherwise
+        uint32_t generation;
+    };
+
+    std::vector<T> values;
+    std::vector<uint32_t> denseToSlot;
+    std::vector<Slot> slots;
+    uint32_t freeHead;
+
+    bool IsFree(uint32_t slot) const {
+        uint32_t dense = slots[slot].target;
+        return dense >= denseToSlot.size() || denseToSlot[dense] != slot;
+    }
+};
+
+#endif
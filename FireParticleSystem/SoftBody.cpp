@@ -0,0 +1,220 @@
+#include "SoftBody.h"
+#include "Simd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const int SUBSTEPS = 4;          // XPBD small steps, one constraint pass each
+    const float DAMPING = 0.5f;      // 1/s, lattice vibrations die out
+    const float SOFTENING = 10.0f;   // px, keeps the field finite at the attractor
+    const int GROUP_GRAIN = 8;       // groups of 4 bodies per parallel chunk
+    const float YIELD = 0.02f;       // strain past which links lengthen for good
+
+    // Hexagonal lattice with spacing 0.5: every node within two steps of the
+    // centre, linked to its neighbours
+    struct Lattice {
+        float restX[SoftBodyState::NODES], restY[SoftBodyState::NODES];
+        int linkA[SoftBodyState::LINKS], linkB[SoftBodyState::LINKS];
+        int links;
+        float restMoment;  // sum of restX^2, the same along any direction
+
+        Lattice() : links(0), restMoment(0) {
+            int n = 0;
+            for (int r = -2; r <= 2; r++) {
+                for (int q = -2; q <= 2; q++) {
+                    if (abs(q + r) > 2) continue;
+                    restX[n] = 0.5f * (q + 0.5f * r);
+                    restY[n] = 0.5f * (0.8660254f * r);
+                    restMoment += restX[n] * restX[n];
+                    n++;
+                }
+            }
+            for (int a = 0; a < n; a++) {
+                for (int b = a + 1; b < n; b++) {
+                    float dx = restX[a] - restX[b], dy = restY[a] - restY[b];
+                    if (dx * dx + dy * dy < 0.26f && links < SoftBodyState::LINKS) {
+                        linkA[links] = a;
+                        linkB[links] = b;
+                        links++;
+                    }
+                }
+            }
+        }
+    };
+
+    const Lattice& Shape() {
+        static const Lattice lattice;
+        return lattice;
+    }
+}
+
+void SoftBodyState::Reset(float radius) {
+    const Lattice& lattice = Shape();
+    for (int n = 0; n < NODES; n++) {
+        x[n] = oldX[n] = lattice.restX[n] * radius;
+        y[n] = oldY[n] = lattice.restY[n] * radius;
+    }
+    for (int l = 0; l < LINKS; l++) {
+        rest[l] = 1.0f;
+    }
+}
+
+Vector2 SoftBodyState::RestNode(int n) {
+    return { Shape().restX[n], Shape().restY[n] };
+}
+
+SoftBodySolver::SoftBodySolver() :
+    count(0),
+    lanes(0),
+    compliance(0.03f) {
+}
+
+void SoftBodySolver::Resize(int bodies) {
+    count = bodies;
+    lanes = (bodies + 3) & ~3;
+    const size_t nodes = static_cast<size_t>(lanes) * SoftBodyState::NODES;
+    x.assign(nodes, 0.0f);
+    y.assign(nodes, 0.0f);
+    oldX.assign(nodes, 0.0f);
+    oldY.assign(nodes, 0.0f);
+    rest.assign(static_cast<size_t>(lanes) * SoftBodyState::LINKS, 1.0f);
+    // padding lanes: no pull, far from the attractor, zero size
+    centreX.assign(lanes, 1e4f);
+    centreY.assign(lanes, 0.0f);
+    radius.assign(lanes, 0.0f);
+    gm.assign(lanes, 0.0f);
+    stretch.assign(lanes, 1.0f);
+}
+
+void SoftBodySolver::Load(int body, const SoftBodyState& state, float bodyRadius, Vector2 relative, float pull) {
+    for (int n = 0; n < SoftBodyState::NODES; n++) {
+        const size_t i = static_cast<size_t>(n) * lanes + body;
+        x[i] = state.x[n];
+        y[i] = state.y[n];
+        oldX[i] = state.oldX[n];
+        oldY[i] = state.oldY[n];
+    }
+    for (int l = 0; l < SoftBodyState::LINKS; l++) {
+        rest[static_cast<size_t>(l) * lanes + body] = state.rest[l];
+    }
+    centreX[body] = relative.x;
+    centreY[body] = relative.y;
+    radius[body] = bodyRadius;
+    gm[body] = pull;
+}
+
+void SoftBodySolver::Store(int body, SoftBodyState& state) const {
+    for (int n = 0; n < SoftBodyState::NODES; n++) {
+        const size_t i = static_cast<size_t>(n) * lanes + body;
+        state.x[n] = x[i];
+        state.y[n] = y[i];
+        state.oldX[n] = oldX[i];
+        state.oldY[n] = oldY[i];
+    }
+    for (int l = 0; l < SoftBodyState::LINKS; l++) {
+        state.rest[l] = rest[static_cast<size_t>(l) * lanes + body];
+    }
+}
+
+void SoftBodySolver::Step(float dt, ThreadPool& pool) {
+    if (count == 0) return;
+    pool.ParallelFor(lanes / 4, GROUP_GRAIN, [&](int begin, int end) {
+        StepGroups(begin * 4, end * 4, dt);
+    });
+}
+
+// Lanes [begin, end), a multiple of 4 apart
+void SoftBodySolver::StepGroups(int begin, int end, float dt) {
+    const Lattice& lattice = Shape();
+    const int NODES = SoftBodyState::NODES;
+    const float h = dt / SUBSTEPS;
+    const Float4 h2 = Float4::Set1(h * h);
+    const Float4 damping = Float4::Set1(1.0f - std::min(DAMPING * h, 1.0f));
+    const Float4 softening = Float4::Set1(SOFTENING * SOFTENING);
+    const Float4 zero = Float4::Set1(0.0f);
+    const Float4 tiny = Float4::Set1(1e-6f);
+    // both ends have inverse mass 1, so a correction is split evenly
+    const Float4 denominator = Float4::Set1(2.0f + compliance / (h * h));
+    const Float4 inverseNodes = Float4::Set1(1.0f / NODES);
+    const Float4 half = Float4::Set1(0.5f);  // link length at radius 1
+    const Float4 yieldLength = Float4::Set1(0.5f * (1.0f + YIELD));
+
+    for (int b = begin; b < end; b += 4) {
+        const Float4 cx = Float4::Load(&centreX[b]);
+        const Float4 cy = Float4::Load(&centreY[b]);
+        const Float4 pull = Float4::Load(&gm[b]);
+        const Float4 size = Float4::Load(&radius[b]);
+        const Float4 yieldSize = Max(size * yieldLength, tiny);
+        // the centre's own acceleration, which the frame already follows
+        const Float4 centreR2 = Max(cx * cx + cy * cy, softening);
+        const Float4 centreScale = pull / (centreR2 * Sqrt(centreR2));
+
+        for (int s = 0; s < SUBSTEPS; s++) {
+            for (int n = 0; n < NODES; n++) {
+                const size_t i = static_cast<size_t>(n) * lanes + b;
+                Float4 px = Float4::Load(&x[i]), py = Float4::Load(&y[i]);
+                Float4 ax = cx + px, ay = cy + py;
+                Float4 r2 = Max(ax * ax + ay * ay, softening);
+                Float4 scale = pull / (r2 * Sqrt(r2));
+                // tidal acceleration: pull at the node minus pull at the centre
+                Float4 tidalX = zero - ax * scale + cx * centreScale;
+                Float4 tidalY = zero - ay * scale + cy * centreScale;
+                Float4 vx = (px - Float4::Load(&oldX[i])) * damping;
+                Float4 vy = (py - Float4::Load(&oldY[i])) * damping;
+                px.Store(&oldX[i]);
+                py.Store(&oldY[i]);
+                (px + vx + tidalX * h2).Store(&x[i]);
+                (py + vy + tidalY * h2).Store(&y[i]);
+            }
+
+            // one Gauss-Seidel pass; lambda starts at 0 every substep
+            for (int c = 0; c < lattice.links; c++) {
+                const size_t ia = static_cast<size_t>(lattice.linkA[c]) * lanes + b;
+                const size_t ib = static_cast<size_t>(lattice.linkB[c]) * lanes + b;
+                Float4 dx = Float4::Load(&x[ia]) - Float4::Load(&x[ib]);
+                Float4 dy = Float4::Load(&y[ia]) - Float4::Load(&y[ib]);
+                Float4 length = Max(Sqrt(dx * dx + dy * dy), tiny);
+                // plastic flow: what is stretched past the yield strain stays
+                const size_t il = static_cast<size_t>(c) * lanes + b;
+                Float4 scale = Max(Float4::Load(&rest[il]), length / yieldSize);
+                scale.Store(&rest[il]);
+                Float4 error = length - size * half * scale;
+                Float4 correction = (zero - error) / (denominator * length);
+                (Float4::Load(&x[ia]) + dx * correction).Store(&x[ia]);
+                (Float4::Load(&y[ia]) + dy * correction).Store(&y[ia]);
+                (Float4::Load(&x[ib]) - dx * correction).Store(&x[ib]);
+                (Float4::Load(&y[ib]) - dy * correction).Store(&y[ib]);
+            }
+        }
+
+        // the owner moves the centre, so numerical drift of the lattice's
+        // mean is removed (history too, which keeps the velocities)
+        Float4 meanX = zero, meanY = zero;
+        for (int n = 0; n < NODES; n++) {
+            const size_t i = static_cast<size_t>(n) * lanes + b;
+            meanX += Float4::Load(&x[i]);
+            meanY += Float4::Load(&y[i]);
+        }
+        meanX *= inverseNodes;
+        meanY *= inverseNodes;
+
+        // spread along the direction to the attractor
+        const Float4 distance = Max(Sqrt(cx * cx + cy * cy), tiny);
+        const Float4 ux = cx / distance, uy = cy / distance;
+        Float4 moment = zero;
+        for (int n = 0; n < NODES; n++) {
+            const size_t i = static_cast<size_t>(n) * lanes + b;
+            Float4 px = Float4::Load(&x[i]) - meanX;
+            Float4 py = Float4::Load(&y[i]) - meanY;
+            px.Store(&x[i]);
+            py.Store(&y[i]);
+            (Float4::Load(&oldX[i]) - meanX).Store(&oldX[i]);
+            (Float4::Load(&oldY[i]) - meanY).Store(&oldY[i]);
+            Float4 along = px * ux + py * uy;
+            moment += along * along;
+        }
+        const Float4 restMoment = Max(size * size * Float4::Set1(lattice.restMoment), tiny);
+        Sqrt(moment / restMoment).Store(&stretch[b]);
+    }
+}
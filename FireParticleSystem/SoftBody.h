@@ -0,0 +1,66 @@
+#pragma once
+#ifndef SOFT_BODY_H
+#define SOFT_BODY_H
+
+#include "raylib.h"
+#include <vector>
+
+class ThreadPool;
+
+// Deformable disc: a small hexagonal lattice (a centre node and two rings)
+// whose neighbours are held together by XPBD distance constraints. Node
+// positions are offsets from the body's centre, which the owner moves; the
+// lattice only feels the tidal part of the field, so it stretches towards
+// the attractor and squeezes across. Links are stiff but yield: stretched
+// past a few percent they lengthen for good, so once tides overcome the
+// body it flows out into a strand instead of springing back.
+struct SoftBodyState {
+    static const int NODES = 19;
+    static const int LINKS = 42;
+
+    float x[NODES], y[NODES];
+    float oldX[NODES], oldY[NODES];  // Verlet history
+    float rest[LINKS];  // rest length of each link over its undeformed length
+
+    // At rest, scaled to radius
+    void Reset(float radius);
+    // Rest position of node n in a body of radius 1
+    static Vector2 RestNode(int n);
+};
+
+// Steps many bodies at once. Bodies are stored node-major with one body per
+// SIMD lane, so every constraint is solved for 4 bodies at a time. Bodies
+// share no nodes, which keeps Gauss-Seidel exact across lanes; groups of 4
+// are split over the thread pool. A body gives the same result however many
+// others it is batched with.
+class SoftBodySolver {
+public:
+    SoftBodySolver();
+
+    void Resize(int count);
+    // relative is the body's centre minus the attractor's position, gm the
+    // strength of its pull (acceleration = gm / distance^2)
+    void Load(int body, const SoftBodyState& state, float radius, Vector2 relative, float gm);
+    void Step(float dt, ThreadPool& pool);
+    void Store(int body, SoftBodyState& state) const;
+
+    // How far the body is drawn out towards the attractor: the spread of its
+    // nodes along that direction over the spread at rest (1 = undeformed)
+    float Stretch(int body) const { return stretch[body]; }
+
+    // Inverse stiffness of the lattice links; 0 is rigid
+    void SetCompliance(float value) { compliance = value; }
+
+private:
+    int count;
+    int lanes;  // count padded to the SIMD width
+    std::vector<float> x, y, oldX, oldY;  // node n of body b at n * lanes + b
+    std::vector<float> rest;              // link l of body b at l * lanes + b
+    std::vector<float> centreX, centreY, radius, gm;
+    std::vector<float> stretch;
+    float compliance;
+
+    void StepGroups(int begin, int end, float dt);
+};
+
+#endif
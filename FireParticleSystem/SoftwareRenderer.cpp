@@ -0,0 +1,366 @@
+#include "SoftwareRenderer.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+
+SoftwareRenderer::SoftwareRenderer(int width, int height, float scale, ThreadPool& pool) :
+    width(width),
+    height(height),
+    scale(scale),
+    tilesX((width + TILE_SIZE - 1) / TILE_SIZE),
+    tilesY((height + TILE_SIZE - 1) / TILE_SIZE),
+    blendMode(BLEND_ALPHA),
+    openSplatCommand(-1),
+    toneMapping(TONEMAP_CLAMP),
+    pool(pool) {
+
+    pixels.resize(static_cast<size_t>(width) * height * 4, 0.0f);
+    tileCommands.resize(static_cast<size_t>(tilesX) * tilesY);
+}
+
+void SoftwareRenderer::Clear(Color color) {
+    // anything still pending would be painted over anyway
+    commands.clear();
+    splats.clear();
+    openSplatCommand = -1;
+
+    const float value[4] = { color.r / 255.0f, color.g / 255.0f, color.b / 255.0f, color.a / 255.0f };
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+        pixels[i + 0] = value[0];
+        pixels[i + 1] = value[1];
+        pixels[i + 2] = value[2];
+        pixels[i + 3] = value[3];
+    }
+}
+
+void SoftwareRenderer::BeginBlendMode(int mode) {
+    blendMode = mode;
+    openSplatCommand = -1;
+}
+
+void SoftwareRenderer::EndBlendMode() {
+    blendMode = BLEND_ALPHA;
+    openSplatCommand = -1;
+}
+
+static void ToFloatColor(Color color, float* out) {
+    out[0] = color.r / 255.0f;
+    out[1] = color.g / 255.0f;
+    out[2] = color.b / 255.0f;
+    out[3] = color.a / 255.0f;
+}
+
+void SoftwareRenderer::Record(Command& command) {
+    float reach = command.radius + 1.0f;
+    command.blendMode = blendMode;
+    command.minX = std::max(0, static_cast<int>(floorf(std::min(command.x0, command.x1) - reach)));
+    command.minY = std::max(0, static_cast<int>(floorf(std::min(command.y0, command.y1) - reach)));
+    command.maxX = std::min(width - 1, static_cast<int>(ceilf(std::max(command.x0, command.x1) + reach)));
+    command.maxY = std::min(height - 1, static_cast<int>(ceilf(std::max(command.y0, command.y1) + reach)));
+
+    if (command.minX > command.maxX || command.minY > command.maxY) return;
+    if (command.inner[3] <= 0.0f && command.outer[3] <= 0.0f) return;
+    commands.push_back(command);
+}
+
+void SoftwareRenderer::DrawCircle(float centerX, float centerY, float radius, Color color) {
+    Command command;
+    command.type = COMMAND_CIRCLE;
+    command.x0 = command.x1 = centerX * scale;
+    command.y0 = command.y1 = centerY * scale;
+    command.radius = radius * scale;
+    ToFloatColor(color, command.inner);
+    ToFloatColor(color, command.outer);
+    Record(command);
+}
+
+void SoftwareRenderer::DrawCircleV(Vector2 center, float radius, Color color) {
+    DrawCircle(center.x, center.y, radius, color);
+}
+
+void SoftwareRenderer::DrawCircleGradient(float centerX, float centerY, float radius, Color inner, Color outer) {
+    Command command;
+    command.type = COMMAND_GRADIENT;
+    command.x0 = command.x1 = centerX * scale;
+    command.y0 = command.y1 = centerY * scale;
+    command.radius = radius * scale;
+    ToFloatColor(inner, command.inner);
+    ToFloatColor(outer, command.outer);
+    Record(command);
+}
+
+void SoftwareRenderer::DrawLineV(Vector2 start, Vector2 end, Color color) {
+    Command command;
+    command.type = COMMAND_LINE;
+    command.x0 = start.x * scale;
+    command.y0 = start.y * scale;
+    command.x1 = end.x * scale;
+    command.y1 = end.y * scale;
+    command.radius = 0.5f * scale;  // one pixel wide at scale 1
+    ToFloatColor(color, command.inner);
+    ToFloatColor(color, command.outer);
+    Record(command);
+}
+
+void SoftwareRenderer::SplatGlow(Vector2 center, float radius, Color color) {
+    if (blendMode != BLEND_ADDITIVE) {
+        DrawCircleV(center, radius, color);
+        return;
+    }
+
+    Splat splat;
+    splat.x = center.x * scale;
+    splat.y = center.y * scale;
+    // (1 - d^2/R^2)^2 integrates to pi R^2 / 3, so R = r sqrt(3) keeps the energy of the circle
+    splat.radius = radius * scale * 1.7320508f;
+
+    float alpha = color.a / 255.0f;
+    if (alpha <= 0.0f) return;
+    splat.color[0] = color.r / 255.0f * alpha;
+    splat.color[1] = color.g / 255.0f * alpha;
+    splat.color[2] = color.b / 255.0f * alpha;
+    splat.color[3] = alpha;
+
+    splat.minX = std::max(0, static_cast<int>(floorf(splat.x - splat.radius)));
+    splat.minY = std::max(0, static_cast<int>(floorf(splat.y - splat.radius)));
+    splat.maxX = std::min(width - 1, static_cast<int>(ceilf(splat.x + splat.radius)));
+    splat.maxY = std::min(height - 1, static_cast<int>(ceilf(splat.y + splat.radius)));
+    if (splat.minX > splat.maxX || splat.minY > splat.maxY) return;
+
+    // additive draws commute, so every splat inside one additive block joins
+    // the same command even when other draws are interleaved
+    if (openSplatCommand < 0) {
+        Command command;
+        command.type = COMMAND_SPLATS;
+        command.blendMode = BLEND_ADDITIVE;
+        command.firstSplat = command.endSplat = static_cast<int>(splats.size());
+        command.minX = 0;
+        command.minY = 0;
+        command.maxX = width - 1;
+        command.maxY = height - 1;
+        openSplatCommand = static_cast<int>(commands.size());
+        commands.push_back(command);
+    }
+    splats.push_back(splat);
+    commands[openSplatCommand].endSplat = static_cast<int>(splats.size());
+}
+
+void SoftwareRenderer::BinSplats() {
+    int tileCount = tilesX * tilesY;
+    tileSplatStart.assign(tileCount + 1, 0);
+
+    for (const Splat& splat : splats) {
+        for (int ty = splat.minY / TILE_SIZE; ty <= splat.maxY / TILE_SIZE; ty++) {
+            for (int tx = splat.minX / TILE_SIZE; tx <= splat.maxX / TILE_SIZE; tx++) {
+                tileSplatStart[ty * tilesX + tx + 1]++;
+            }
+        }
+    }
+    for (int i = 0; i < tileCount; i++) {
+        tileSplatStart[i + 1] += tileSplatStart[i];
+    }
+
+    // indices end up in increasing order per tile, which AccumulateSplats relies on
+    std::vector<int> fill(tileSplatStart.begin(), tileSplatStart.end() - 1);
+    tileSplats.resize(tileSplatStart[tileCount]);
+    for (size_t i = 0; i < splats.size(); i++) {
+        const Splat& splat = splats[i];
+        for (int ty = splat.minY / TILE_SIZE; ty <= splat.maxY / TILE_SIZE; ty++) {
+            for (int tx = splat.minX / TILE_SIZE; tx <= splat.maxX / TILE_SIZE; tx++) {
+                tileSplats[fill[ty * tilesX + tx]++] = static_cast<int>(i);
+            }
+        }
+    }
+}
+
+void SoftwareRenderer::Flush() {
+    for (auto& bin : tileCommands) {
+        bin.clear();
+    }
+    BinSplats();
+
+    for (size_t i = 0; i < commands.size(); i++) {
+        const Command& command = commands[i];
+        for (int ty = command.minY / TILE_SIZE; ty <= command.maxY / TILE_SIZE; ty++) {
+            for (int tx = command.minX / TILE_SIZE; tx <= command.maxX / TILE_SIZE; tx++) {
+                tileCommands[ty * tilesX + tx].push_back(static_cast<int>(i));
+            }
+        }
+    }
+
+    pool.ParallelFor(tilesX * tilesY, 1, [this](int begin, int end) {
+        for (int tile = begin; tile < end; tile++) {
+            RasterizeTile(tile);
+        }
+    });
+
+    commands.clear();
+    splats.clear();
+    openSplatCommand = -1;
+}
+
+void SoftwareRenderer::RasterizeTile(int tile) {
+    int x0 = (tile % tilesX) * TILE_SIZE;
+    int y0 = (tile / tilesX) * TILE_SIZE;
+    int x1 = std::min(x0 + TILE_SIZE, width);
+    int y1 = std::min(y0 + TILE_SIZE, height);
+
+    int splatCursor = tileSplatStart[tile];
+    for (int index : tileCommands[tile]) {
+        const Command& command = commands[index];
+        if (command.type == COMMAND_SPLATS) {
+            AccumulateSplats(command, tile, splatCursor, x0, y0, x1, y1);
+        }
+        else {
+            RasterizeCommand(command, x0, y0, x1, y1);
+        }
+    }
+}
+
+void SoftwareRenderer::AccumulateSplats(const Command& command, int tile, int& cursor, int x0, int y0, int x1, int y1) {
+    const int first = command.firstSplat;
+    const int last = command.endSplat;
+    const int tileEnd = tileSplatStart[tile + 1];
+    const Float4 one = Float4::Set1(1.0f);
+    const Float4 zero = Float4::Set1(0.0f);
+    float weights[4];
+
+    while (cursor < tileEnd && tileSplats[cursor] < first) cursor++;
+
+    for (; cursor < tileEnd && tileSplats[cursor] < last; cursor++) {
+        const Splat& splat = splats[tileSplats[cursor]];
+        int xs = std::max(x0, splat.minX);
+        int xe = std::min(x1, splat.maxX + 1);
+        int ys = std::max(y0, splat.minY);
+        int ye = std::min(y1, splat.maxY + 1);
+
+        const Float4 color = Float4::Load(splat.color);
+        const Float4 cx = Float4::Set1(splat.x);
+        const Float4 invRadius2 = Float4::Set1(1.0f / (splat.radius * splat.radius));
+
+        for (int y = ys; y < ye; y++) {
+            const Float4 dy = Float4::Set1(y + 0.5f - splat.y);
+            const Float4 dy2 = dy * dy;
+            float* row = &pixels[static_cast<size_t>(y) * width * 4];
+
+            for (int x = xs; x < xe; x += 4) {
+                Float4 dx = Float4::Set(x + 0.5f, x + 1.5f, x + 2.5f, x + 3.5f) - cx;
+                Float4 falloff = Max(one - (dx * dx + dy2) * invRadius2, zero);
+                (falloff * falloff).Store(weights);
+
+                int lanes = std::min(4, xe - x);
+                for (int i = 0; i < lanes; i++) {
+                    if (weights[i] <= 0.0f) continue;
+                    float* pixel = row + static_cast<size_t>(x + i) * 4;
+                    (Float4::Load(pixel) + color * Float4::Set1(weights[i])).Store(pixel);
+                }
+            }
+        }
+    }
+}
+
+void SoftwareRenderer::RasterizeCommand(const Command& command, int x0, int y0, int x1, int y1) {
+    int xs = std::max(x0, command.minX);
+    int xe = std::min(x1, command.maxX + 1);
+    int ys = std::max(y0, command.minY);
+    int ye = std::min(y1, command.maxY + 1);
+    if (xs >= xe || ys >= ye) return;
+
+    const bool additive = command.blendMode == BLEND_ADDITIVE;
+    const bool gradient = command.type == COMMAND_GRADIENT;
+    const Float4 inner = Float4::Load(command.inner);
+    const Float4 innerToOuter = Float4::Load(command.outer) - inner;
+    const Float4 one = Float4::Set1(1.0f);
+    const Float4 edge = Float4::Set1(command.radius + 0.5f);
+    const Float4 cx = Float4::Set1(command.x0);
+    const Float4 cy = Float4::Set1(command.y0);
+
+    // line direction, scaled so the projection lands in [0, 1]
+    float ex = command.x1 - command.x0;
+    float ey = command.y1 - command.y0;
+    float length2 = ex * ex + ey * ey;
+    const Float4 dirX = Float4::Set1(ex);
+    const Float4 dirY = Float4::Set1(ey);
+    const Float4 invLength2 = Float4::Set1(length2 > 0.0f ? 1.0f / length2 : 0.0f);
+    const Float4 invRadius = Float4::Set1(command.radius > 0.0f ? 1.0f / command.radius : 0.0f);
+
+    float coverage[4];
+    float gradientT[4];
+
+    for (int y = ys; y < ye; y++) {
+        const Float4 dy = Float4::Set1(y + 0.5f) - cy;
+        float* row = &pixels[static_cast<size_t>(y) * width * 4];
+
+        for (int x = xs; x < xe; x += 4) {
+            Float4 dx = Float4::Set(x + 0.5f, x + 1.5f, x + 2.5f, x + 3.5f) - cx;
+            Float4 dist;
+
+            if (command.type == COMMAND_LINE) {
+                Float4 t = Clamp01((dx * dirX + dy * dirY) * invLength2);
+                Float4 px = dx - t * dirX;
+                Float4 py = dy - t * dirY;
+                dist = Sqrt(px * px + py * py);
+            }
+            else {
+                dist = Sqrt(dx * dx + dy * dy);
+            }
+
+            Clamp01(edge - dist).Store(coverage);
+            if (gradient) Min(dist * invRadius, one).Store(gradientT);
+
+            int lanes = std::min(4, xe - x);
+            for (int i = 0; i < lanes; i++) {
+                if (coverage[i] <= 0.0f) continue;
+
+                Float4 color = inner;
+                float alpha = command.inner[3];
+                if (gradient) {
+                    color = inner + innerToOuter * Float4::Set1(gradientT[i]);
+                    alpha += (command.outer[3] - command.inner[3]) * gradientT[i];
+                }
+
+                float* pixel = row + static_cast<size_t>(x + i) * 4;
+                Float4 dst = Float4::Load(pixel);
+                Float4 weight = Float4::Set1(alpha * coverage[i]);
+                if (additive) dst += color * weight;
+                else dst += (color - dst) * weight;
+                dst.Store(pixel);
+            }
+        }
+    }
+}
+
+void SoftwareRenderer::ToRGBA8(std::vector<unsigned char>& out) const {
+    out.resize(static_cast<size_t>(width) * height * 4);
+
+    const bool softClip = toneMapping == TONEMAP_SOFT_CLIP;
+    const float knee = 0.8f;
+
+    pool.ParallelFor(height, 16, [&](int begin, int end) {
+        for (size_t i = static_cast<size_t>(begin) * width * 4; i < static_cast<size_t>(end) * width * 4; i += 4) {
+            for (int c = 0; c < 3; c++) {
+                float value = std::max(pixels[i + c], 0.0f);
+                if (softClip && value > knee) {
+                    // exponential shoulder, matches the identity's slope at the knee
+                    value = knee + (1.0f - knee) * (1.0f - expf(-(value - knee) / (1.0f - knee)));
+                }
+                value = std::min(value, 1.0f);
+                out[i + c] = static_cast<unsigned char>(value * 255.0f + 0.5f);
+            }
+            out[i + 3] = 255;
+        }
+    });
+}
+
+bool SoftwareRenderer::Export(const char* fileName) const {
+    std::vector<unsigned char> rgba;
+    ToRGBA8(rgba);
+
+    Image image;
+    image.data = rgba.data();
+    image.width = width;
+    image.height = height;
+    image.mipmaps = 1;
+    image.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+    return ExportImage(image, fileName);
+}
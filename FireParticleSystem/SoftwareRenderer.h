@@ -0,0 +1,110 @@
+#pragma once
+#ifndef SOFTWARE_RENDERER_H
+#define SOFTWARE_RENDERER_H
+
+#include "raylib.h"
+#include "ThreadPool.h"
+#include <vector>
+
+// CPU rasterizer for headless rendering without a GPU or OpenGL context.
+// Implements the subset of raylib drawing calls the simulation uses. Calls are
+// recorded and binned into screen tiles, Flush() then rasterizes the tiles in
+// parallel into a float RGBA framebuffer. Draw order is kept inside each tile
+// so alpha blending matches the GPU path.
+//
+// Glow splats drawn in additive mode skip the general command path: they are
+// counting-sorted into tiles and accumulated per tile into the HDR buffer,
+// which is tone mapped when the image is read back.
+class SoftwareRenderer {
+public:
+    static const int TILE_SIZE = 64;
+
+    enum ToneMapping {
+        TONEMAP_CLAMP,      // same as the GPU path
+        TONEMAP_SOFT_CLIP   // identity up to a knee, then rolls off towards white
+    };
+
+    // scale multiplies all coordinates, so scenes laid out for the window can
+    // be rendered at a higher resolution
+    SoftwareRenderer(int width, int height, float scale = 1.0f, ThreadPool& pool = ThreadPool::Shared());
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+    void Clear(Color color);
+    void BeginBlendMode(int mode);
+    void EndBlendMode();
+
+    void DrawCircle(float centerX, float centerY, float radius, Color color);
+    void DrawCircleV(Vector2 center, float radius, Color color);
+    void DrawCircleGradient(float centerX, float centerY, float radius, Color inner, Color outer);
+    void DrawLineV(Vector2 start, Vector2 end, Color color);
+
+    // Soft round splat carrying the same energy as a circle of this radius.
+    // Outside additive blend mode it falls back to DrawCircleV.
+    void SplatGlow(Vector2 center, float radius, Color color);
+
+    void SetToneMapping(ToneMapping mode) { toneMapping = mode; }
+
+    // Rasterizes everything recorded since the last flush
+    void Flush();
+
+    // Linear RGBA floats, 4 per pixel, values above 1 are possible with additive blending
+    const float* Pixels() const { return pixels.data(); }
+    float* MutablePixels() { return pixels.data(); }
+
+    void ToRGBA8(std::vector<unsigned char>& out) const;
+    bool Export(const char* fileName) const;
+
+private:
+    enum CommandType {
+        COMMAND_CIRCLE,
+        COMMAND_GRADIENT,
+        COMMAND_LINE,
+        COMMAND_SPLATS   // range of glow splats [firstSplat, endSplat)
+    };
+
+    struct Command {
+        int type;
+        int blendMode;
+        float x0, y0, x1, y1;  // center, or line start and end
+        float radius;          // circle radius or line half width
+        float inner[4];
+        float outer[4];
+        int minX, minY, maxX, maxY;
+        int firstSplat, endSplat;  // COMMAND_SPLATS only
+    };
+
+    struct Splat {
+        float x, y;
+        float radius;
+        float color[4];  // premultiplied by alpha
+        int minX, minY, maxX, maxY;
+    };
+
+    int width;
+    int height;
+    float scale;
+    int tilesX;
+    int tilesY;
+    int blendMode;
+    int openSplatCommand;  // splat batch that new splats join, -1 if none
+    ToneMapping toneMapping;
+    ThreadPool& pool;
+
+    std::vector<float> pixels;
+    std::vector<Command> commands;
+    std::vector<std::vector<int>> tileCommands;
+
+    std::vector<Splat> splats;
+    std::vector<int> tileSplatStart;  // counting sort of splats by tile
+    std::vector<int> tileSplats;
+
+    void Record(Command& command);
+    void BinSplats();
+    void RasterizeTile(int tile);
+    void RasterizeCommand(const Command& command, int x0, int y0, int x1, int y1);
+    void AccumulateSplats(const Command& command, int tile, int& cursor, int x0, int y0, int x1, int y1);
+};
+
+#endif
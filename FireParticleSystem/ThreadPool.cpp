@@ -0,0 +1,108 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+    thread_local bool insideWorker = false;
+}
+
+ThreadPool::ThreadPool(int threadCount) :
+    job(nullptr),
+    jobCount(0),
+    jobGrain(1),
+    nextIndex(0),
+    busyWorkers(0),
+    generation(0),
+    stopping(false) {
+
+    if (threadCount <= 0) {
+        threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    for (int i = 1; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::RunChunks(const std::function<void(int, int)>& fn, int count, int grain) {
+    for (;;) {
+        int begin = nextIndex.fetch_add(grain);
+        if (begin >= count) break;
+        int end = std::min(begin + grain, count);
+        fn(begin, end);
+    }
+}
+
+void ThreadPool::WorkerLoop() {
+    insideWorker = true;
+    unsigned seen = 0;
+
+    for (;;) {
+        const std::function<void(int, int)>* fn;
+        int count, grain;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            if (!job) continue;
+            fn = job;
+            count = jobCount;
+            grain = jobGrain;
+            busyWorkers++;
+        }
+
+        RunChunks(*fn, count, grain);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyWorkers--;
+        }
+        done.notify_all();
+    }
+}
+
+void ThreadPool::ParallelFor(int count, int grainSize, const std::function<void(int, int)>& fn) {
+    if (count <= 0) return;
+    grainSize = std::max(1, grainSize);
+
+    if (workers.empty() || insideWorker || count <= grainSize) {
+        fn(0, count);
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit(submitMutex);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] { return busyWorkers == 0; });
+        job = &fn;
+        jobCount = count;
+        jobGrain = grainSize;
+        nextIndex.store(0);
+        generation++;
+    }
+    wake.notify_all();
+
+    insideWorker = true;
+    RunChunks(fn, count, grainSize);
+    insideWorker = false;
+
+    // workers that wake up after this point see no job and go back to sleep
+    std::unique_lock<std::mutex> lock(mutex);
+    job = nullptr;
+    done.wait(lock, [&] { return busyWorkers == 0; });
+}
+
+ThreadPool& ThreadPool::Shared() {
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fork/join pool for data-parallel loops. The calling thread takes part
+// in the work, so a pool with N threads runs N - 1 workers.
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::mutex submitMutex;  // one ParallelFor at a time
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const std::function<void(int, int)>* job;
+    int jobCount;
+    int jobGrain;
+    std::atomic<int> nextIndex;
+    int busyWorkers;
+    unsigned generation;
+    bool stopping;
+
+    void WorkerLoop();
+    void RunChunks(const std::function<void(int, int)>& fn, int count, int grain);
+
+public:
+    // threadCount <= 0 uses every hardware thread
+    explicit ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int ThreadCount() const { return static_cast<int>(workers.size()) + 1; }
+
+    // Calls fn(begin, end) over [0, count) in chunks of grainSize and returns
+    // when all chunks are done. Nested calls from a worker run inline.
+    void ParallelFor(int count, int grainSize, const std::function<void(int, int)>& fn);
+
+    static ThreadPool& Shared();
+};
+
+#endif
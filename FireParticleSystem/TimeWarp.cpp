@@ -0,0 +1,60 @@
+#include "TimeWarp.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+    const int WARP_LEVELS[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 };
+    const int WARP_LEVEL_COUNT = sizeof(WARP_LEVELS) / sizeof(WARP_LEVELS[0]);
+    const double RATE_WINDOW = 0.5;
+}
+
+TimeWarp::TimeWarp(double frameBudgetSeconds) :
+    level(0),
+    frameBudget(frameBudgetSeconds),
+    pending(0),
+    windowSim(0),
+    windowWall(0),
+    achievedRate(0) {
+}
+
+void TimeWarp::Faster() {
+    level = std::min(level + 1, WARP_LEVEL_COUNT - 1);
+}
+
+void TimeWarp::Slower() {
+    level = std::max(level - 1, 0);
+}
+
+int TimeWarp::Factor() const {
+    return WARP_LEVELS[level];
+}
+
+int TimeWarp::Advance(float frameTime, const std::function<void(float)>& step) {
+    // a long hitch (window drag, breakpoint) shouldn't turn into a burst of steps
+    double wall = std::min(static_cast<double>(frameTime), 0.25);
+    pending += wall * Factor();
+
+    auto start = std::chrono::steady_clock::now();
+    int steps = 0;
+    while (pending >= FIXED_DT) {
+        step(FIXED_DT);
+        pending -= FIXED_DT;
+        steps++;
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() > frameBudget) {
+            // drop what didn't fit instead of carrying an ever growing backlog
+            pending = 0;
+            break;
+        }
+    }
+
+    windowSim += steps * static_cast<double>(FIXED_DT);
+    windowWall += wall;
+    if (windowWall >= RATE_WINDOW) {
+        achievedRate = windowSim / windowWall;
+        windowSim = 0;
+        windowWall = 0;
+    }
+    return steps;
+}
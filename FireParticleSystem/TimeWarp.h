@@ -0,0 +1,39 @@
+#pragma once
+#ifndef TIME_WARP_H
+#define TIME_WARP_H
+
+#include <functional>
+
+// Fast-forward control. Each displayed frame asks for frameTime * factor
+// seconds of simulation, which is run as fixed physics steps with no drawing
+// in between. Steps stop when the wall-clock budget for the frame is used up,
+// so a warp factor the machine can't keep up with degrades to the achieved
+// rate instead of stalling the window.
+class TimeWarp {
+public:
+    static constexpr float FIXED_DT = 1.0f / 60.0f;
+
+    explicit TimeWarp(double frameBudgetSeconds = 0.012);
+
+    void Faster();
+    void Slower();
+    int Factor() const;
+
+    // Runs the steps owed for this frame through step(FIXED_DT) and returns
+    // how many ran
+    int Advance(float frameTime, const std::function<void(float)>& step);
+
+    // Simulated seconds per wall-clock second, averaged over about half a second
+    double AchievedRate() const { return achievedRate; }
+
+private:
+    int level;
+    double frameBudget;
+    double pending;        // simulated seconds owed but not yet stepped
+
+    double windowSim;
+    double windowWall;
+    double achievedRate;
+};
+
+#endif
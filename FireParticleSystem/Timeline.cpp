@@ -0,0 +1,182 @@
+#include "Timeline.h"
+
+namespace {
+    // Groups byte i of every 4-byte word together. Floats that change a little
+    // keep their sign/exponent bytes, which then XOR to long runs of zeros.
+    void Shuffle(const std::vector<uint8_t>& raw, std::vector<uint8_t>& out) {
+        size_t words = raw.size() / 4;
+        out.resize(raw.size());
+        for (size_t i = 0; i < words; i++) {
+            for (size_t plane = 0; plane < 4; plane++) {
+                out[plane * words + i] = raw[i * 4 + plane];
+            }
+        }
+        for (size_t i = words * 4; i < raw.size(); i++) out[i] = raw[i];
+    }
+
+    void Unshuffle(const std::vector<uint8_t>& shuffled, std::vector<uint8_t>& out) {
+        size_t words = shuffled.size() / 4;
+        out.resize(shuffled.size());
+        for (size_t i = 0; i < words; i++) {
+            for (size_t plane = 0; plane < 4; plane++) {
+                out[i * 4 + plane] = shuffled[plane * words + i];
+            }
+        }
+        for (size_t i = words * 4; i < shuffled.size(); i++) out[i] = shuffled[i];
+    }
+
+    void PutVarint(std::vector<uint8_t>& out, size_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    size_t GetVarint(const uint8_t*& p) {
+        size_t value = 0;
+        int shift = 0;
+        for (;;) {
+            uint8_t b = *p++;
+            value |= static_cast<size_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) return value;
+            shift += 7;
+        }
+    }
+
+    // shorter zero runs are cheaper to keep inside a literal
+    const size_t MIN_ZERO_RUN = 4;
+}
+
+KeyframeBuffer::KeyframeBuffer(size_t maxKeyframes, size_t memoryBudget) :
+    maxKeyframes(std::max<size_t>(maxKeyframes, 1)),
+    memoryBudget(memoryBudget),
+    memoryBytes(0),
+    sinceFull(0) {
+}
+
+// Token stream of (zero run length, literal length, literal bytes) over the
+// shuffled state XOR the reference
+void KeyframeBuffer::Encode(const std::vector<uint8_t>& shuffled, const std::vector<uint8_t>* reference,
+    std::vector<uint8_t>& out) const {
+    const size_t n = shuffled.size();
+    auto value = [&](size_t k) -> uint8_t {
+        return reference ? static_cast<uint8_t>(shuffled[k] ^ (*reference)[k]) : shuffled[k];
+    };
+
+    out.clear();
+    size_t i = 0;
+    while (i < n) {
+        size_t zeros = i;
+        while (zeros < n && value(zeros) == 0) zeros++;
+
+        size_t literal = zeros;
+        while (literal < n) {
+            if (value(literal) != 0) {
+                literal++;
+                continue;
+            }
+            size_t run = literal;
+            while (run < n && run - literal < MIN_ZERO_RUN && value(run) == 0) run++;
+            if (run - literal >= MIN_ZERO_RUN || run == n) break;
+            literal = run;
+        }
+
+        PutVarint(out, zeros - i);
+        PutVarint(out, literal - zeros);
+        for (size_t k = zeros; k < literal; k++) out.push_back(value(k));
+        i = literal;
+    }
+    out.shrink_to_fit();
+}
+
+// shuffled must hold the previous keyframe when decoding a delta
+void KeyframeBuffer::Decode(const Keyframe& keyframe, std::vector<uint8_t>& shuffled) const {
+    if (keyframe.full) shuffled.assign(keyframe.rawSize, 0);
+
+    const uint8_t* p = keyframe.data.data();
+    const uint8_t* end = p + keyframe.data.size();
+    size_t pos = 0;
+    while (p < end) {
+        pos += GetVarint(p);
+        size_t literal = GetVarint(p);
+        for (size_t k = 0; k < literal; k++, pos++) {
+            shuffled[pos] = keyframe.full ? p[k] : static_cast<uint8_t>(shuffled[pos] ^ p[k]);
+        }
+        p += literal;
+    }
+}
+
+void KeyframeBuffer::DecodeShuffled(size_t index, std::vector<uint8_t>& shuffled) const {
+    size_t first = index;
+    while (!keyframes[first].full) first--;
+    for (size_t i = first; i <= index; i++) {
+        Decode(keyframes[i], shuffled);
+    }
+}
+
+void KeyframeBuffer::Add(int64_t step, const std::vector<uint8_t>& state) {
+    Shuffle(state, scratch);
+
+    Keyframe keyframe;
+    keyframe.step = step;
+    keyframe.rawSize = state.size();
+    keyframe.full = keyframes.empty() || sinceFull + 1 >= FULL_INTERVAL || lastShuffled.size() != scratch.size();
+    Encode(scratch, keyframe.full ? nullptr : &lastShuffled, keyframe.data);
+    sinceFull = keyframe.full ? 0 : sinceFull + 1;
+    lastShuffled.swap(scratch);
+
+    memoryBytes += keyframe.data.size();
+    keyframes.push_back(std::move(keyframe));
+
+    while (keyframes.size() > maxKeyframes || (memoryBytes > memoryBudget && keyframes.size() > 1)) {
+        EvictOldest();
+    }
+}
+
+// The oldest keyframe is always full; its successor is re-encoded as full
+// before it becomes the oldest
+void KeyframeBuffer::EvictOldest() {
+    if (keyframes.size() > 1 && !keyframes[1].full) {
+        std::vector<uint8_t> shuffled;
+        DecodeShuffled(1, shuffled);
+        memoryBytes -= keyframes[1].data.size();
+        Encode(shuffled, nullptr, keyframes[1].data);
+        keyframes[1].full = true;
+        memoryBytes += keyframes[1].data.size();
+    }
+    memoryBytes -= keyframes.front().data.size();
+    keyframes.pop_front();
+}
+
+int64_t KeyframeBuffer::Restore(int64_t step, std::vector<uint8_t>& state) const {
+    auto it = std::upper_bound(keyframes.begin(), keyframes.end(), step,
+        [](int64_t s, const Keyframe& k) { return s < k.step; });
+    if (it == keyframes.begin()) return -1;
+    size_t index = static_cast<size_t>(it - keyframes.begin()) - 1;
+
+    std::vector<uint8_t> shuffled;
+    DecodeShuffled(index, shuffled);
+    Unshuffle(shuffled, state);
+    return keyframes[index].step;
+}
+
+void KeyframeBuffer::TruncateAfter(int64_t step) {
+    while (!keyframes.empty() && keyframes.back().step > step) {
+        memoryBytes -= keyframes.back().data.size();
+        keyframes.pop_back();
+    }
+
+    sinceFull = 0;
+    lastShuffled.clear();
+    if (keyframes.empty()) return;
+    for (size_t i = keyframes.size() - 1; !keyframes[i].full; i--) sinceFull++;
+    DecodeShuffled(keyframes.size() - 1, lastShuffled);
+}
+
+void KeyframeBuffer::Clear() {
+    keyframes.clear();
+    lastShuffled.clear();
+    memoryBytes = 0;
+    sinceFull = 0;
+}
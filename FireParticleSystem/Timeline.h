@@ -0,0 +1,232 @@
+#pragma once
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// Appends plain values to a byte buffer. Columns of a struct array are
+// written one field at a time, which keeps similar bytes next to each other
+// and makes keyframe deltas compress well.
+class StateWriter {
+public:
+    explicit StateWriter(std::vector<uint8_t>& buffer) : out(buffer) { out.clear(); }
+
+    template <typename T>
+    void Write(const T& value) {
+        size_t at = out.size();
+        out.resize(at + sizeof(T));
+        memcpy(out.data() + at, &value, sizeof(T));
+    }
+
+    template <typename T>
+    void WriteArray(const std::vector<T>& values) {
+        Write(static_cast<uint64_t>(values.size()));
+        size_t at = out.size();
+        out.resize(at + values.size() * sizeof(T));
+        if (!values.empty()) memcpy(out.data() + at, values.data(), values.size() * sizeof(T));
+    }
+
+    // field(item) returns the value to store for each item
+    template <typename T, typename Field>
+    void WriteColumn(const std::vector<T>& items, Field field) {
+        for (const T& item : items) Write(field(item));
+    }
+
+private:
+    std::vector<uint8_t>& out;
+};
+
+// Counterpart of StateWriter. Every read returns false instead of running
+// past the end of the buffer.
+class StateReader {
+public:
+    StateReader(const uint8_t* data, size_t size) : cursor(data), end(data + size) {}
+
+    template <typename T>
+    bool Read(T& value) {
+        if (static_cast<size_t>(end - cursor) < sizeof(T)) return false;
+        memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    bool ReadArray(std::vector<T>& values) {
+        uint64_t count;
+        if (!Read(count) || count > static_cast<uint64_t>(end - cursor) / sizeof(T)) return false;
+        values.resize(static_cast<size_t>(count));
+        if (count) memcpy(values.data(), cursor, values.size() * sizeof(T));
+        cursor += values.size() * sizeof(T);
+        return true;
+    }
+
+    // field(item) returns a reference to the member to fill in
+    template <typename T, typename Field>
+    bool ReadColumn(std::vector<T>& items, Field field) {
+        for (T& item : items) {
+            if (!Read(field(item))) return false;
+        }
+        return true;
+    }
+
+    bool AtEnd() const { return cursor == end; }
+
+private:
+    const uint8_t* cursor;
+    const uint8_t* end;
+};
+
+// Bounded ring of serialized simulation states. Each keyframe is byte-plane
+// shuffled, XORed against the previous one and zero run-length encoded, so
+// particles that barely moved cost a few bytes. Every FULL_INTERVAL-th
+// keyframe (and any whose size changed) is stored without a reference to
+// limit how many deltas a restore has to walk through.
+class KeyframeBuffer {
+public:
+    KeyframeBuffer(size_t maxKeyframes, size_t memoryBudget);
+
+    void Add(int64_t step, const std::vector<uint8_t>& state);
+
+    // Decodes the newest keyframe at or before step. Returns its step, or -1
+    // when the buffer holds nothing that old.
+    int64_t Restore(int64_t step, std::vector<uint8_t>& state) const;
+
+    // Drops every keyframe after step
+    void TruncateAfter(int64_t step);
+    void Clear();
+
+    bool Empty() const { return keyframes.empty(); }
+    size_t Count() const { return keyframes.size(); }
+    int64_t FirstStep() const { return keyframes.empty() ? -1 : keyframes.front().step; }
+    int64_t LastStep() const { return keyframes.empty() ? -1 : keyframes.back().step; }
+    size_t MemoryBytes() const { return memoryBytes; }
+
+    static const int FULL_INTERVAL = 8;
+
+private:
+    struct Keyframe {
+        int64_t step;
+        bool full;
+        size_t rawSize;
+        std::vector<uint8_t> data;
+    };
+
+    std::deque<Keyframe> keyframes;
+    size_t maxKeyframes;
+    size_t memoryBudget;
+    size_t memoryBytes;
+    int sinceFull;
+    std::vector<uint8_t> lastShuffled;  // newest keyframe, reference for the next delta
+    std::vector<uint8_t> scratch;
+
+    void Encode(const std::vector<uint8_t>& shuffled, const std::vector<uint8_t>* reference, std::vector<uint8_t>& out) const;
+    void Decode(const Keyframe& keyframe, std::vector<uint8_t>& shuffled) const;
+    void DecodeShuffled(size_t index, std::vector<uint8_t>& shuffled) const;
+    void EvictOldest();
+};
+
+// Records a deterministic simulation so any earlier step can be shown again.
+// Keyframes are taken every keyframeInterval steps; commands (user input)
+// are logged with the step they were applied before, and a past step is
+// rebuilt by loading the nearest keyframe and re-simulating at most
+// keyframeInterval - 1 steps with the logged commands.
+//
+// Sim needs Update(float), StepIndex(), Apply(const Command&),
+// SaveState(std::vector<uint8_t>&) and LoadState(const uint8_t*, size_t).
+template <typename Sim, typename Command>
+class Timeline {
+public:
+    Timeline(Sim& simulation, float stepDt, int keyframeInterval = 60,
+        size_t maxKeyframes = 600, size_t memoryBudget = size_t(256) << 20) :
+        sim(simulation),
+        dt(stepDt),
+        interval(std::max(keyframeInterval, 1)),
+        keyframes(maxKeyframes, memoryBudget),
+        scrubbing(false) {
+        head = sim.StepIndex();
+        sim.SaveState(state);
+        keyframes.Add(head, state);
+    }
+
+    // Queues input for the next live step
+    void Submit(const Command& command) {
+        commands.emplace_back(sim.StepIndex(), command);
+    }
+
+    void Step() {
+        ApplyCommands(sim.StepIndex());
+        sim.Update(dt);
+        head = sim.StepIndex();
+        if (head % interval == 0) {
+            sim.SaveState(state);
+            keyframes.Add(head, state);
+            // commands before the oldest keyframe can never be replayed again
+            int64_t first = keyframes.FirstStep();
+            auto keep = std::find_if(commands.begin(), commands.end(),
+                [first](const std::pair<int64_t, Command>& c) { return c.first >= first; });
+            commands.erase(commands.begin(), keep);
+        }
+    }
+
+    // Rebuilds the simulation at step, clamped to the recorded range, and
+    // pauses live stepping until Resume()
+    void Seek(int64_t step) {
+        scrubbing = true;
+        step = std::max(std::min(step, head), Earliest());
+
+        int64_t current = sim.StepIndex();
+        int64_t keyframeStep = step - step % interval;
+        if (step < current || keyframeStep > current) {
+            int64_t restored = keyframes.Restore(step, state);
+            if (restored < 0 || !sim.LoadState(state.data(), state.size())) return;
+        }
+        while (sim.StepIndex() < step) {
+            ApplyCommands(sim.StepIndex());
+            sim.Update(dt);
+        }
+    }
+
+    // Continues live from the current step, discarding the recorded future
+    void Resume() {
+        int64_t current = sim.StepIndex();
+        if (current < head) {
+            keyframes.TruncateAfter(current);
+            commands.erase(std::remove_if(commands.begin(), commands.end(),
+                [current](const std::pair<int64_t, Command>& c) { return c.first >= current; }), commands.end());
+            head = current;
+        }
+        scrubbing = false;
+    }
+
+    bool IsScrubbing() const { return scrubbing; }
+    int64_t Current() const { return sim.StepIndex(); }
+    int64_t Head() const { return head; }
+    int64_t Earliest() const { return keyframes.FirstStep(); }
+    int Interval() const { return interval; }
+    const KeyframeBuffer& Keyframes() const { return keyframes; }
+
+private:
+    Sim& sim;
+    float dt;
+    int interval;
+    KeyframeBuffer keyframes;
+    std::vector<std::pair<int64_t, Command>> commands;  // ordered by step
+    std::vector<uint8_t> state;
+    int64_t head;  // newest simulated step
+    bool scrubbing;
+
+    void ApplyCommands(int64_t step) {
+        auto first = std::lower_bound(commands.begin(), commands.end(), step,
+            [](const std::pair<int64_t, Command>& c, int64_t s) { return c.first < s; });
+        for (auto it = first; it != commands.end() && it->first == step; ++it) {
+            sim.Apply(it->second);
+        }
+    }
+};
+
+#endif
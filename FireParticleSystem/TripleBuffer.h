@@ -0,0 +1,44 @@
+#pragma once
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Lock-free hand-over of whole frames from one producer thread to one
+// consumer thread. The producer fills Back() and publishes it; the consumer
+// picks up the newest published slot with Acquire() and reads Front() for as
+// long as it likes. Neither side ever waits for the other, a frame the
+// consumer was too slow to see is simply replaced.
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : ready(1), back(0), front(2) {}
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // Producer side
+    T& Back() { return slots[back]; }
+    void Publish() {
+        back = ready.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Consumer side. Returns true when a newer frame was swapped in.
+    bool Acquire() {
+        if (!(ready.load(std::memory_order_relaxed) & FRESH)) return false;
+        front = ready.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+    const T& Front() const { return slots[front]; }
+
+private:
+    static const int INDEX_MASK = 3;
+    static const int FRESH = 4;  // set while the ready slot hasn't been acquired yet
+
+    T slots[3];
+    std::atomic<int> ready;  // index of the slot between producer and consumer
+    int back;                // owned by the producer
+    int front;               // owned by the consumer
+};
+
+#endif
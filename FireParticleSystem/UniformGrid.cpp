@@ -0,0 +1,104 @@
+#include "UniformGrid.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+UniformGrid::UniformGrid() :
+    originX(0),
+    originY(0),
+    cellSize(1),
+    columns(1),
+    rows(1),
+    coverOriginX(0),
+    coverOriginY(0),
+    inverseCellSize(1),
+    coverColumns(0),
+    coverRows(0) {
+}
+
+void UniformGrid::Build(const std::vector<Vector2>& itemPositions, const std::vector<float>& itemRadii) {
+    positions = itemPositions;
+    radii = itemRadii;
+    const int count = static_cast<int>(positions.size());
+
+    float minX = 0, minY = 0, maxX = 0, maxY = 0, maxRadius = 0;
+    for (int i = 0; i < count; i++) {
+        const Vector2& p = positions[i];
+        if (i == 0 || p.x < minX) minX = p.x;
+        if (i == 0 || p.y < minY) minY = p.y;
+        if (i == 0 || p.x > maxX) maxX = p.x;
+        if (i == 0 || p.y > maxY) maxY = p.y;
+        maxRadius = std::max(maxRadius, radii[i]);
+    }
+
+    // sparse scenes would need huge grids with the natural cell size, so the
+    // cell count is capped at a few cells per item
+    cellSize = std::max(maxRadius * 2.0f, 1.0f);
+    const float maxCells = std::max(16.0f, 4.0f * count);
+    for (;;) {
+        columns = static_cast<int>((maxX - minX) / cellSize) + 1;
+        rows = static_cast<int>((maxY - minY) / cellSize) + 1;
+        float cells = static_cast<float>(columns) * static_cast<float>(rows);
+        if (cells <= maxCells) break;
+        cellSize *= std::max(sqrtf(cells / maxCells), 1.01f);
+    }
+    originX = minX;
+    originY = minY;
+
+    // counting sort by cell
+    cellStart.assign(columns * rows + 1, 0);
+    std::vector<int> cellOf(count);
+    for (int i = 0; i < count; i++) {
+        int cx, cy;
+        CellOf(positions[i], cx, cy);
+        cellOf[i] = cy * columns + cx;
+        cellStart[cellOf[i] + 1]++;
+    }
+    for (size_t c = 1; c < cellStart.size(); c++) {
+        cellStart[c] += cellStart[c - 1];
+    }
+    cellItems.resize(count);
+    std::vector<int> cursor(cellStart.begin(), cellStart.end() - 1);
+    for (int i = 0; i < count; i++) {
+        cellItems[cursor[cellOf[i]]++] = i;
+    }
+
+    BuildCoverage();
+}
+
+// Same cell size, one cell of margin so circles at the border fit
+void UniformGrid::BuildCoverage() {
+    const int count = static_cast<int>(positions.size());
+    coverOriginX = originX - cellSize;
+    coverOriginY = originY - cellSize;
+    inverseCellSize = 1.0f / cellSize;
+    coverColumns = count > 0 ? columns + 2 : 0;
+    coverRows = count > 0 ? rows + 2 : 0;
+    coverStart.assign(coverColumns * coverRows + 1, 0);
+
+    auto forEachCovered = [&](int i, const std::function<void(int)>& f) {
+        int x0 = static_cast<int>((positions[i].x - radii[i] - coverOriginX) / cellSize);
+        int x1 = static_cast<int>((positions[i].x + radii[i] - coverOriginX) / cellSize);
+        int y0 = static_cast<int>((positions[i].y - radii[i] - coverOriginY) / cellSize);
+        int y1 = static_cast<int>((positions[i].y + radii[i] - coverOriginY) / cellSize);
+        for (int y = std::max(y0, 0); y <= std::min(y1, coverRows - 1); y++) {
+            for (int x = std::max(x0, 0); x <= std::min(x1, coverColumns - 1); x++) {
+                f(y * coverColumns + x);
+            }
+        }
+    };
+
+    for (int i = 0; i < count; i++) {
+        if (radii[i] <= 0.0f) continue;
+        forEachCovered(i, [&](int cell) { coverStart[cell + 1]++; });
+    }
+    for (size_t c = 1; c < coverStart.size(); c++) {
+        coverStart[c] += coverStart[c - 1];
+    }
+    coverItems.resize(coverStart.back());
+    std::vector<int> cursor(coverStart.begin(), coverStart.end() - 1);
+    for (int i = 0; i < count; i++) {
+        if (radii[i] <= 0.0f) continue;
+        forEachCovered(i, [&](int cell) { coverItems[cursor[cell]++] = i; });
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+#ifndef UNIFORM_GRID_H
+#define UNIFORM_GRID_H
+
+#include "raylib.h"
+#include <cstddef>
+#include <vector>
+
+// Broadphase for circles. The grid covers the bounding box of the items,
+// cells are as wide as the largest diameter, so a circle only overlaps
+// circles in its own and the 8 neighbouring cells. Items are counting-sorted
+// into cells, which makes a rebuild O(n) with no per-cell allocations, and
+// the grid keeps its own copy of the items so it can be queried from worker
+// threads while the originals change.
+//
+// Point queries, which run once per particle, use a second index that lists
+// each circle in every cell its bounding square touches (at most 4), so they
+// read a single cell.
+class UniformGrid {
+public:
+    UniformGrid();
+
+    void Build(const std::vector<Vector2>& positions, const std::vector<float>& radii);
+
+    // Calls f(i, j) with i < j for every pair of overlapping circles and
+    // returns the number of candidate pairs the grid had to test
+    template <typename F>
+    int ForEachOverlappingPair(F f) const {
+        int candidates = 0;
+        for (int i = 0; i < static_cast<int>(positions.size()); i++) {
+            int cx, cy;
+            CellOf(positions[i], cx, cy);
+            for (int y = cy - 1; y <= cy + 1; y++) {
+                if (y < 0 || y >= rows) continue;
+                for (int x = cx - 1; x <= cx + 1; x++) {
+                    if (x < 0 || x >= columns) continue;
+                    int cell = y * columns + x;
+                    for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+                        int j = cellItems[k];
+                        if (j <= i) continue;
+                        candidates++;
+                        float dx = positions[j].x - positions[i].x;
+                        float dy = positions[j].y - positions[i].y;
+                        float reach = radii[i] + radii[j];
+                        if (dx * dx + dy * dy < reach * reach) f(i, j);
+                    }
+                }
+            }
+        }
+        return candidates;
+    }
+
+    // Calls f(i) for every circle containing point
+    template <typename F>
+    void ForEachContaining(Vector2 point, F f) const {
+        float fx = (point.x - coverOriginX) * inverseCellSize;
+        float fy = (point.y - coverOriginY) * inverseCellSize;
+        if (!(fx >= 0.0f && fy >= 0.0f && fx < coverColumns && fy < coverRows)) return;
+        int cell = static_cast<int>(fy) * coverColumns + static_cast<int>(fx);
+        for (int k = coverStart[cell]; k < coverStart[cell + 1]; k++) {
+            int i = coverItems[k];
+            float dx = point.x - positions[i].x;
+            float dy = point.y - positions[i].y;
+            if (dx * dx + dy * dy < radii[i] * radii[i]) f(i);
+        }
+    }
+
+    size_t Size() const { return positions.size(); }
+    int CellCount() const { return columns * rows; }
+
+private:
+    std::vector<Vector2> positions;
+    std::vector<float> radii;
+    std::vector<int> cellStart;  // items of cell c are cellItems[cellStart[c], cellStart[c + 1])
+    std::vector<int> cellItems;
+    float originX, originY;
+    float cellSize;
+    int columns, rows;
+    std::vector<int> coverStart;  // same layout for the point query index
+    std::vector<int> coverItems;
+    float coverOriginX, coverOriginY;
+    float inverseCellSize;
+    int coverColumns, coverRows;
+
+    // Clamped, so points outside the grid land in the border cells
+    void CellOf(Vector2 p, int& cx, int& cy) const {
+        float fx = (p.x - originX) / cellSize;
+        float fy = (p.y - originY) / cellSize;
+        cx = fx < 0 ? 0 : (fx >= columns ? columns - 1 : static_cast<int>(fx));
+        cy = fy < 0 ? 0 : (fy >= rows ? rows - 1 : static_cast<int>(fy));
+    }
+
+    void BuildCoverage();
+};
+
+#endif